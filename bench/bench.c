@@ -0,0 +1,332 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <pthread.h>
+#include <rsg/rsg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Headless benchmarks of the CPU side of the library: scene building and
+ * teardown, traversal, property sets, binding propagation and cross-thread
+ * property update storms. GL calls go to the null backend, so the numbers
+ * include the cost of making the calls but not of executing them.
+ *
+ * Usage: rsg_bench [output.json] [scale]
+ * Results go to output.json (default rsg_bench.json, "-" for stdout, which
+ * the library also logs to). The scale multiplies all scene sizes.
+ */
+
+#define TRAVERSAL_FRAMES 20
+#define STORM_THREADS 4
+
+static FILE* out = NULL;
+static bool firstResult = true;
+static size_t numCallbacks = 0;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void result(const char* name, const char* unit, double value) {
+  fprintf(out, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f}",
+          firstResult ? "" : ",", name, unit, value);
+  firstResult = false;
+}
+
+static void countCallback(void* cookie) {
+  numCallbacks++;
+}
+
+static mat4s translation(float x) {
+  return glms_translate_make((vec3s){{x, 0.0f, 0.0f}});
+}
+
+/*
+ * Scenes. All nodes go into a flat array in creation order, parents before
+ * their children, so destroying them in order never destroys a child first.
+ */
+typedef struct {
+  RsgNode* root;
+  RsgNode** nodes;
+  size_t numNodes;
+} Scene;
+
+static RsgNode* addNode(Scene* scene, RsgNode* node) {
+  scene->nodes[scene->numNodes++] = node;
+  return node;
+}
+
+// depth levels of group { transform, callback, next level }
+static void buildDeep(Scene* scene, size_t depth) {
+  size_t i;
+  scene->nodes = malloc(depth * 3 * sizeof(*scene->nodes));
+  scene->numNodes = 0;
+
+  RsgNode* group = scene->root = addNode(scene, rsgGroupNodeCreate());
+  for (i = 0; i < depth; i++) {
+    rsgGroupNodeAddChild(
+        group, addNode(scene, rsgTransformNodeCreate(translation(0.001f))));
+    rsgGroupNodeAddChild(
+        group, addNode(scene, rsgCallbackNodeCreate(countCallback, NULL)));
+    if (i + 1 == depth) break;
+
+    RsgNode* child = addNode(scene, rsgGroupNodeCreate());
+    rsgGroupNodeAddChild(group, child);
+    group = child;
+  }
+}
+
+// one group of width children, alternating transforms and callbacks
+static void buildWide(Scene* scene, size_t width) {
+  size_t i;
+  scene->nodes = malloc((width + 1) * sizeof(*scene->nodes));
+  scene->numNodes = 0;
+
+  scene->root = addNode(scene, rsgGroupNodeCreate());
+  for (i = 0; i < width; i++) {
+    RsgNode* child = i % 2 == 0
+                         ? rsgTransformNodeCreate(translation(0.001f))
+                         : rsgCallbackNodeCreate(countCallback, NULL);
+    rsgGroupNodeAddChild(scene->root, addNode(scene, child));
+  }
+}
+
+// count triangle meshes under a shader, either all sharing one geometry
+// (drawn instanced) or each with its own
+static void buildMeshes(Scene* scene, size_t count, bool shared) {
+  size_t i;
+  scene->nodes = malloc((count + 2) * sizeof(*scene->nodes));
+  scene->numNodes = 0;
+
+  scene->root = addNode(scene, rsgGroupNodeCreate());
+  rsgGroupNodeAddChild(scene->root,
+                       addNode(scene, rsgShaderNodeCreateFromMemory("", "")));
+  for (i = 0; i < count; i++) {
+    RsgNode* mesh = shared && i > 0 ? rsgMeshNodeCreateShared(scene->nodes[2])
+                                    : rsgMeshNodeCreateTriangle();
+    rsgGroupNodeAddChild(scene->root, addNode(scene, mesh));
+  }
+}
+
+static void buildSharedMeshes(Scene* scene, size_t count) {
+  buildMeshes(scene, count, true);
+}
+
+static void buildUniqueMeshes(Scene* scene, size_t count) {
+  buildMeshes(scene, count, false);
+}
+
+static void destroyScene(Scene* scene) {
+  size_t i;
+  for (i = 0; i < scene->numNodes; i++) rsgNodeDestroy(scene->nodes[i]);
+  free(scene->nodes);
+}
+
+/*
+ * Benchmarks
+ */
+static void benchScene(const char* name,
+                       void (*build)(Scene*, size_t),
+                       size_t size,
+                       int numThreads) {
+  Scene scene;
+  char key[128];
+  int i;
+
+  rsgSetUpdateThreads(numThreads);
+  double start = now();
+  build(&scene, size);
+  double built = now();
+  rsgTraverse(scene.root);  // compile and warm up
+  double warm = now();
+  for (i = 0; i < TRAVERSAL_FRAMES; i++) rsgTraverse(scene.root);
+  double traversed = now();
+
+  rsgGlRecordingStart(false);
+  rsgTraverse(scene.root);
+  RsgGlRecording* rec = rsgGlRecordingStop();
+  size_t numGlCalls = rsgGlRecordingGetNumCalls(rec, NULL);
+  rsgGlRecordingDestroy(rec);
+
+  double teardown = now();
+  destroyScene(&scene);
+  double destroyed = now();
+
+  snprintf(key, sizeof(key), "%s.build.threads%d", name, numThreads);
+  result(key, "ns/node", (built - start) / scene.numNodes);
+  snprintf(key, sizeof(key), "%s.first_traversal.threads%d", name, numThreads);
+  result(key, "ns/node", (warm - built) / scene.numNodes);
+  snprintf(key, sizeof(key), "%s.traversal.threads%d", name, numThreads);
+  result(key, "ns/node",
+         (traversed - warm) / TRAVERSAL_FRAMES / scene.numNodes);
+  snprintf(key, sizeof(key), "%s.teardown.threads%d", name, numThreads);
+  result(key, "ns/node", (destroyed - teardown) / scene.numNodes);
+  snprintf(key, sizeof(key), "%s.gl_calls.threads%d", name, numThreads);
+  result(key, "calls/frame", numGlCalls);
+}
+
+static void benchPropertySet(size_t count) {
+  RsgNode* node = rsgTransformNodeCreate(translation(0.0f));
+  const RsgProperty* prop = rsgNodeLookupProperty(node, "matrix");
+  size_t i;
+
+  double start = now();
+  for (i = 0; i < count; i++)
+    rsgNodeSetPropertyMat4(node, prop, translation((float)i));
+  double byHandle = now();
+  for (i = 0; i < count; i++)
+    rsgNodeSetProperty(node, "matrix", rsgValueMat4(translation((float)i)));
+  double byName = now();
+  rsgTraverse(node);
+
+  result("property.set_by_handle", "sets/s", count / (byHandle - start) * 1e9);
+  result("property.set_by_name", "sets/s", count / (byName - byHandle) * 1e9);
+  rsgNodeDestroy(node);
+}
+
+// a chain of length bindings between transform matrices
+static void benchBindingChain(size_t length, size_t rounds) {
+  RsgNode** nodes = malloc((length + 1) * sizeof(*nodes));
+  RsgNode* idle = rsgGroupNodeCreate();
+  size_t i;
+
+  double start = now();
+  for (i = 0; i <= length; i++) {
+    nodes[i] = rsgTransformNodeCreate(translation(0.0f));
+    if (i > 0) rsgNodeBindProperty(nodes[i - 1], "matrix", nodes[i], "matrix");
+  }
+  double bound = now();
+
+  const RsgProperty* prop = rsgNodeLookupProperty(nodes[0], "matrix");
+  double latency = 0.0;
+  for (i = 0; i < rounds; i++) {
+    double set = now();
+    rsgNodeSetPropertyMat4(nodes[0], prop, translation((float)i + 1.0f));
+    rsgTraverse(idle);  // bindings are evaluated at the start of the frame
+    latency += now() - set;
+    mat4s last = rsgNodeGetPropertyMat4(nodes[length], prop);
+    if (last.raw[3][0] != (float)i + 1.0f) {
+      fprintf(stderr, "binding chain didn't propagate\n");
+      exit(1);
+    }
+  }
+
+  result("binding.chain.bind", "ns/binding", (bound - start) / length);
+  result("binding.chain.latency", "ns", latency / rounds);
+  result("binding.chain.latency_per_binding", "ns/binding",
+         latency / rounds / length);
+  for (i = 0; i <= length; i++) rsgNodeDestroy(nodes[i]);
+  rsgNodeDestroy(idle);
+  free(nodes);
+}
+
+typedef struct {
+  RsgNode** nodes;
+  size_t numNodes;
+  size_t numPosts;
+} Storm;
+
+static void* postStorm(void* arg) {
+  const Storm* storm = arg;
+  const RsgProperty* prop = rsgNodeLookupProperty(storm->nodes[0], "matrix");
+  size_t i;
+  for (i = 0; i < storm->numPosts; i++)
+    rsgNodePostPropertyValue(storm->nodes[i % storm->numNodes], prop,
+                             rsgValueMat4(translation((float)i)));
+  return NULL;
+}
+
+// several threads posting property updates at once, applied in one frame
+static void benchStorm(size_t numNodes, size_t postsPerThread) {
+  pthread_t threads[STORM_THREADS];
+  Storm storm = {malloc(numNodes * sizeof(RsgNode*)), numNodes,
+                 postsPerThread};
+  RsgNode* idle = rsgGroupNodeCreate();
+  size_t i;
+  for (i = 0; i < numNodes; i++)
+    storm.nodes[i] = rsgTransformNodeCreate(translation(0.0f));
+
+  double start = now();
+  for (i = 0; i < STORM_THREADS; i++)
+    pthread_create(&threads[i], NULL, postStorm, &storm);
+  for (i = 0; i < STORM_THREADS; i++) pthread_join(threads[i], NULL);
+  double posted = now();
+  rsgTraverse(idle);
+  double applied = now();
+
+  size_t numPosts = STORM_THREADS * postsPerThread;
+  result("storm.post", "posts/s", numPosts / (posted - start) * 1e9);
+  result("storm.apply", "ns/post", (applied - posted) / numPosts);
+  for (i = 0; i < numNodes; i++) rsgNodeDestroy(storm.nodes[i]);
+  rsgNodeDestroy(idle);
+  free(storm.nodes);
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "rsg_bench.json";
+  size_t scale = argc > 2 ? (size_t)atoi(argv[2]) : 1;
+  int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  struct rusage usage;
+
+  if (scale == 0) {
+    fprintf(stderr, "usage: %s [output.json] [scale]\n", argv[0]);
+    return 1;
+  }
+  out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  rsgInit(0, 0, RSG_INIT_FLAG_NODISPLAY);
+
+  fprintf(out, "{\n  \"scale\": %zu,\n  \"results\": [", scale);
+  benchScene("deep", buildDeep, 1000 * scale, 0);
+  benchScene("wide", buildWide, 100000 * scale, 0);
+  if (numThreads > 0) {
+    benchScene("deep", buildDeep, 1000 * scale, numThreads);
+    benchScene("wide", buildWide, 100000 * scale, numThreads);
+  }
+  benchScene("meshes_shared", buildSharedMeshes, 10000 * scale, 0);
+  benchScene("meshes_unique", buildUniqueMeshes, 10000 * scale, 0);
+  benchPropertySet(1000000 * scale);
+  benchBindingChain(1000 * scale, 100);
+  benchStorm(1000, 100000 * scale);
+
+  getrusage(RUSAGE_SELF, &usage);
+  result("peak_rss", "KiB", usage.ru_maxrss);
+  fprintf(out, "\n  ]\n}\n");
+  if (out != stdout) fclose(out);
+
+  printf("RSG: %zu callbacks run\n", numCallbacks);
+  if (numCallbacks == 0) {
+    // the deep and wide numbers would be those of empty nodes
+    fprintf(stderr, "RSG: the scenes' callbacks never ran\n");
+    return 1;
+  }
+  return 0;
+}
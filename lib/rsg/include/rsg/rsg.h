@@ -32,6 +32,9 @@
 
 #define RSG_INIT_FLAG_FULLSCREEN 1
 #define RSG_INIT_FLAG_HIDECURSOR 2
+#define RSG_INIT_FLAG_PIPELINED 4 /* submit frame N while building N+1 */
+#define RSG_INIT_FLAG_NODISPLAY 8 /* no window; GL goes to the null backend */
+#define RSG_INIT_FLAG_OFFSCREEN 16 /* EGL, no window: draw into a FBO */
 
 /*******************************************************************************
  * DATA.
@@ -75,11 +78,51 @@ typedef struct {
 
 typedef struct RsgClosure RsgClosure;
 
+/**
+ * @brief Property handle, resolved once from a node type and a name
+ */
+typedef struct RsgProperty RsgProperty;
+
 /**
  * @brief Opaque node type
  */
 typedef struct RsgNode RsgNode;
 
+/**
+ * @brief Counted and optionally recorded GL calls
+ */
+typedef struct RsgGlRecording RsgGlRecording;
+
+/**
+ * @brief Time spent in a node (or all nodes of a type) since the last reset
+ */
+typedef struct {
+  RsgNode* node;  // NULL for types and finalized nodes
+  const char* typeName;
+  size_t calls;
+  double cpuInclusiveMs;  // including nested nodes (e.g. group children)
+  double cpuExclusiveMs;
+  double gpuMs;  // inclusive
+} RsgProfileStat;
+
+/**
+ * @brief Output of a frame capture to a file
+ */
+typedef enum {
+  RSG_CAPTURE_RAW,  // RGBA, top row first, frames back to back
+  RSG_CAPTURE_Y4M,  // YUV4MPEG2, 4:2:0
+} RsgCaptureFormat;
+
+/**
+ * @brief Receives the captured frames on the capture thread (RGBA, bottom
+ * row first)
+ */
+typedef void (*RsgCaptureFunc)(const unsigned char* pixels,
+                               int width,
+                               int height,
+                               size_t frame,
+                               void* cookie);
+
 /*******************************************************************************
  * FUNCTIONS.
  */
@@ -89,6 +132,39 @@ typedef struct RsgNode RsgNode;
 extern void rsgMallocSetDebug(bool value);
 extern void rsgMallocPrintStat(void);
 
+/*
+ * Per-node CPU/GPU profiler (non-pipelined frames)
+ */
+extern void rsgProfilerSetEnabled(bool value);
+extern void rsgProfilerReset(void);
+extern size_t rsgProfilerGetNumFrames(void);
+extern size_t rsgProfilerGetNodeStat(RsgProfileStat* stats, size_t maxStats);
+extern size_t rsgProfilerGetTypeStat(RsgProfileStat* stats, size_t maxStats);
+extern void rsgProfilerPrintStat(void);
+
+/*
+ * GL dispatch: the null backend turns GL calls into no-ops, to measure the
+ * CPU cost alone; a recording counts (and keeps) the calls of any backend
+ */
+extern void rsgGlSetNullBackend(bool value);
+extern void rsgGlRecordingStart(bool keepCalls);
+extern RsgGlRecording* rsgGlRecordingStop(void);
+extern size_t rsgGlRecordingGetNumCalls(const RsgGlRecording* rec,
+                                        const char* name);
+extern void rsgGlRecordingPrint(const RsgGlRecording* rec);
+extern void rsgGlRecordingReplay(const RsgGlRecording* rec);
+extern void rsgGlRecordingDestroy(RsgGlRecording* rec);
+
+/*
+ * Frame capture: presented frames are read back a few frames late, so the
+ * GPU is never waited for, and written out on a background thread. The size
+ * is fixed at start; frames are dropped while the framebuffer differs
+ */
+extern bool rsgCaptureStart(const char* path, RsgCaptureFormat format, int fps);
+extern bool rsgCaptureStartWithCallback(RsgCaptureFunc func, void* cookie);
+extern void rsgCaptureStop(void);
+extern void rsgCaptureGetStat(size_t* written, size_t* dropped, size_t* stalls);
+
 /*
  * Value container helpers.
  */
@@ -106,14 +182,82 @@ extern RsgValue rsgValueMat4(mat4s val);
  */
 extern void rsgInit(int width, int height, int flags);
 extern void rsgMainLoop(RsgNode* root, int traversalFreq);
+extern void rsgMainLoopQuit(void);
+extern void rsgTraverse(RsgNode* root); /* one frame, no events or display */
 extern int rsgGetScreenWidth(void);
 extern int rsgGetScreenHeight(void);
+extern void rsgSetFrameArenaSize(size_t size);
+extern void rsgSetUpdateThreads(int numThreads);
+extern void rsgSetSwapInterval(int interval);
+extern void rsgSetFrameSpin(int usec);
+extern void rsgGetFrameDeadlineStat(size_t* frames, size_t* missed);
+extern size_t rsgGetFrameArenaHighWater(void);
+extern void rsgGetGlStateStat(size_t* issuedCalls, size_t* elidedCalls);
+extern void rsgGetDrawStat(size_t* drawCalls, size_t* instances);
+extern void rsgGetCullStat(size_t* tested, size_t* culled, size_t* drawn);
+extern void rsgGetBindingStat(size_t* evaluated);
+
+/*
+ * Change tracking: retained mode only redraws when the scene is dirty
+ */
+extern void rsgNodeMarkDirty(RsgNode* node);
 
 /*
- * Properties of nodes
+ * Node lifetime: groups don't own their children, so destroy a group before
+ * the nodes in it
+ */
+extern void rsgNodeDestroy(RsgNode* node);
+
+/*
+ * Properties of nodes. Unknown names are warned about: the lookup returns
+ * NULL, and the by-name accessors and bindings do nothing
  */
 extern RsgValue rsgNodeGetProperty(RsgNode* node, const char* name);
 extern void rsgNodeSetProperty(RsgNode* node, const char* name, RsgValue value);
+extern const RsgProperty* rsgNodeLookupProperty(RsgNode* node,
+                                                const char* name);
+extern RsgValueType rsgPropertyGetType(const RsgProperty* prop);
+extern const char* rsgPropertyGetName(const RsgProperty* prop);
+extern void rsgNodeSetPropertyValue(RsgNode* node,
+                                    const RsgProperty* prop,
+                                    RsgValue value);
+extern RsgValue rsgNodeGetPropertyValue(RsgNode* node,
+                                        const RsgProperty* prop);
+extern void rsgNodeSetPropertyPointer(RsgNode* node,
+                                      const RsgProperty* prop,
+                                      void* value);
+extern void rsgNodeSetPropertyInt(RsgNode* node,
+                                  const RsgProperty* prop,
+                                  int value);
+extern void rsgNodeSetPropertyFloat(RsgNode* node,
+                                    const RsgProperty* prop,
+                                    float value);
+extern void rsgNodeSetPropertyVec2(RsgNode* node,
+                                   const RsgProperty* prop,
+                                   vec2s value);
+extern void rsgNodeSetPropertyVec3(RsgNode* node,
+                                   const RsgProperty* prop,
+                                   vec3s value);
+extern void rsgNodeSetPropertyVec4(RsgNode* node,
+                                   const RsgProperty* prop,
+                                   vec4s value);
+extern void rsgNodeSetPropertyMat4(RsgNode* node,
+                                   const RsgProperty* prop,
+                                   mat4s value);
+extern void* rsgNodeGetPropertyPointer(RsgNode* node, const RsgProperty* prop);
+extern int rsgNodeGetPropertyInt(RsgNode* node, const RsgProperty* prop);
+extern float rsgNodeGetPropertyFloat(RsgNode* node, const RsgProperty* prop);
+extern vec2s rsgNodeGetPropertyVec2(RsgNode* node, const RsgProperty* prop);
+extern vec3s rsgNodeGetPropertyVec3(RsgNode* node, const RsgProperty* prop);
+extern vec4s rsgNodeGetPropertyVec4(RsgNode* node, const RsgProperty* prop);
+extern mat4s rsgNodeGetPropertyMat4(RsgNode* node, const RsgProperty* prop);
+/*
+ * Property updates from any thread: queued without blocking, and applied
+ * together at the start of the next frame
+ */
+extern void rsgNodePostPropertyValue(RsgNode* node,
+                                     const RsgProperty* prop,
+                                     RsgValue value);
 extern void rsgNodeBindProperty(RsgNode* node,
                                 const char* name,
                                 RsgNode* toNode,
@@ -124,14 +268,16 @@ extern void rsgNodeBindPropertyWithClosure(RsgNode* node,
                                            const char* toName,
                                            RsgClosure* toTransform);
 /*
- * Closures
+ * Closures: func(binding, from, to, cookie) computes the value of the target
+ * property into "to" (pre-set to the target type) from the "from" value
  */
 extern RsgClosure* rsgClosureCreate(void(*func),
                                     const void* cookie,
                                     size_t sizeofCookie);
 
 /*
- * Callback node
+ * Callback node. The function is called on the render thread with no vertex
+ * array or program bound; it may change any GL state.
  */
 extern RsgNode* rsgCallbackNodeCreate(void (*func)(void*), void* cookie);
 
@@ -140,6 +286,19 @@ extern RsgNode* rsgCallbackNodeCreate(void (*func)(void*), void* cookie);
  */
 extern RsgNode* rsgGroupNodeCreate(void);
 extern void rsgGroupNodeAddChild(RsgNode* groupNode, RsgNode* childNode);
+extern void rsgGroupNodeInsertChildren(RsgNode* groupNode,
+                                       size_t index,
+                                       RsgNode** childNodes,
+                                       size_t numChildNodes);
+extern void rsgGroupNodeRemoveChildren(RsgNode* groupNode,
+                                       size_t index,
+                                       size_t numChildNodes);
+extern void rsgGroupNodeRemoveChild(RsgNode* groupNode, RsgNode* childNode);
+extern void rsgGroupNodeMoveChild(RsgNode* groupNode,
+                                  size_t fromIndex,
+                                  size_t toIndex);
+extern size_t rsgGroupNodeGetNumChildren(RsgNode* groupNode);
+extern RsgNode* rsgGroupNodeGetChild(RsgNode* groupNode, size_t index);
 
 /*
  * Screen node
@@ -161,13 +320,18 @@ extern RsgNode* rsgCameraNodeCreate(vec3s position,
                                     bool perspective);
 
 /*
- * Shader node
+ * Shader node. Programs built from sources get the vertex attributes
+ * "a_position", "a_normal" and "a_texcoord" at locations 0, 1 and 2, and the
+ * per-instance mat4 "a_model" at 4 to 7, unless the sources place them.
  */
 extern RsgNode* rsgShaderNodeCreate(unsigned int program);
 extern RsgNode* rsgShaderNodeCreateFromMemory(const char* vertexText,
                                               const char* fragmentText);
 extern RsgNode* rsgShaderNodeCreateFromFiles(const char* vertexPath,
                                              const char* fragmentPath);
+/* Deletes a program given to rsgShaderNodeCreate(); use it instead of
+ * glDeleteProgram(), so that what RSG learnt of the program is dropped too */
+extern void rsgShaderProgramDelete(unsigned int program);
 
 /*
  * Mouse manipulator node
@@ -179,7 +343,25 @@ extern RsgNode* rsgMouseManipulatorNodeCreate(void);
  */
 extern RsgNode* rsgPropertyPrinterNodeCreate(void);
 
+/*
+ * Transform node
+ */
+extern RsgNode* rsgTransformNodeCreate(mat4s matrix);
+
 /*
  * Mesh draw node.
  */
 extern RsgNode* rsgMeshNodeCreateTriangle(void);
+extern RsgNode* rsgMeshNodeCreateShared(RsgNode* meshNode);
+/* Wavefront OBJ or binary (see rsgMeshFileConvert()); attributes: 0 position,
+ * 1 normal, 2 texture coordinate (see the shader node) */
+extern RsgNode* rsgMeshNodeCreateFromFile(const char* path);
+extern bool rsgMeshFileConvert(const char* inputPath, const char* outputPath);
+/* Mesh geometry is sub-allocated from shared buffers, one set per vertex
+ * layout; compaction closes the holes left by destroyed meshes */
+extern void rsgGeometryPoolCompact(void);
+extern void rsgGeometryPoolGetStat(size_t* usedBytes,
+                                   size_t* capacityBytes,
+                                   size_t* numGeometries,
+                                   size_t* numHoles);
+extern void rsgGeometryPoolPrintStat(void);
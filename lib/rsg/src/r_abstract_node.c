@@ -23,7 +23,38 @@
 
 #include "rsg_internal.h"
 
-G_DEFINE_TYPE(RsgAbstractNode, rsg_abstract_node, G_TYPE_OBJECT)
+/*
+ * Dirty tracking.
+ * A node is dirty when its dirty generation equals the current one. Marking
+ * a node dirty propagates to all its parents, stopping at nodes that are
+ * already dirty, so a clean root means a clean scene. Nodes that compile to
+ * nothing (rsgAbstractNodeCompileNothing()) don't propagate: nothing of them
+ * is drawn, and their changes reach the scene only through the bindings and
+ * targets they drive. Advancing the generation cleans every node at once.
+ *
+ * Change notification.
+ * Nodes announce property changes with rsgAbstractNodeNotify() rather than
+ * g_object_notify_by_pspec(). The first announcement in a frame freezes the
+ * node's notify queue, which GObject keeps free of duplicates; the main loop
+ * thaws all such nodes at once in the notification phase, before deciding on
+ * a redraw. So each (node, property) pair is delivered once, with its final
+ * value, however often it was set. Handlers that set properties again feed
+ * the next wave of the same phase.
+ */
+typedef struct {
+  guint dirtyGeneration;
+  GSList* parents;  // groups this node is a child of (one entry per edge)
+  bool polled;
+  bool notifyPending;  // frozen, in pendingNotify
+} RsgAbstractNodePrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE(RsgAbstractNode, rsg_abstract_node, G_TYPE_OBJECT)
+
+static guint currentGeneration = 1;
+static GList* polledNodes = NULL;
+static GPtrArray* pendingNotify = NULL;
+static GPtrArray* flushingNotify = NULL;
+static guint notifySignalId = 0;
 
 static void process(RsgAbstractNode* node, RsgContext* ctx) {
   const char* className = g_type_name_from_instance((GTypeInstance*)node);
@@ -32,58 +63,202 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
   assert(0);
 }
 
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  /*
+   * By default, nodes are processed live during replay.
+   */
+  RsgAbstractNodeClass* klass = RSG_ABSTRACT_NODE_GET_CLASS(node);
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_PROCESS,
+                                  .node = node,
+                                  .processFunc = klass->processFunc});
+}
+
+static void dispatch_properties_changed(GObject* object,
+                                        guint n_pspecs,
+                                        GParamSpec** pspecs) {
+  rsgAbstractNodeMarkDirty(RSG_ABSTRACT_NODE(object));
+
+  G_OBJECT_CLASS(rsg_abstract_node_parent_class)
+      ->dispatch_properties_changed(object, n_pspecs, pspecs);
+}
+
+static void finalize(GObject* object) {
+  RsgAbstractNodePrivate* priv =
+      rsg_abstract_node_get_instance_private(RSG_ABSTRACT_NODE(object));
+  g_slist_free(priv->parents);
+  if (priv->polled) polledNodes = g_list_remove(polledNodes, object);
+
+  G_OBJECT_CLASS(rsg_abstract_node_parent_class)->finalize(object);
+}
+
 static void rsg_abstract_node_class_init(RsgAbstractNodeClass* klass) {
   klass->processFunc = process;
+  klass->compileFunc = compile;
+  klass->pollFunc = NULL;
+  klass->boundsFunc = NULL;
+  klass->updateFunc = NULL;
+
+  notifySignalId = g_signal_lookup("notify", G_TYPE_OBJECT);
+  pendingNotify = g_ptr_array_new();
+  flushingNotify = g_ptr_array_new();
+
+  G_OBJECT_CLASS(klass)->dispatch_properties_changed =
+      dispatch_properties_changed;
+  G_OBJECT_CLASS(klass)->finalize = finalize;
 }
 
-static void rsg_abstract_node_init(RsgAbstractNode* node) {}
+static void rsg_abstract_node_init(RsgAbstractNode* node) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  // new nodes start dirty
+  priv->dirtyGeneration = currentGeneration;
+  priv->parents = NULL;
+  priv->polled = false;
+  priv->notifyPending = false;
+}
 
-RsgValue rsgNodeGetProperty(RsgNode* node, const char* name) {
-  assert(RSG_IS_ABSTRACT_NODE(node) != false);
+void rsgAbstractNodeCompileNothing(RsgAbstractNode* node,
+                                   RsgRenderList* list) {}
+
+void rsgAbstractNodeMarkDirty(RsgAbstractNode* node) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  if (priv->dirtyGeneration == currentGeneration) return;
+  priv->dirtyGeneration = currentGeneration;
+  if (RSG_ABSTRACT_NODE_GET_CLASS(node)->compileFunc ==
+      rsgAbstractNodeCompileNothing)
+    return;
+
+  GSList* elem;
+  for (elem = priv->parents; elem != NULL; elem = elem->next)
+    rsgAbstractNodeMarkDirty(elem->data);
+}
+
+bool rsgAbstractNodeIsDirty(RsgAbstractNode* node) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  return priv->dirtyGeneration == currentGeneration;
+}
+
+void rsgAbstractNodeCleanAll(void) {
+  currentGeneration++;
+}
+
+void rsgAbstractNodeAddParent(RsgAbstractNode* node, RsgAbstractNode* parent) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  priv->parents = g_slist_prepend(priv->parents, parent);
+}
+
+void rsgAbstractNodeRemoveParent(RsgAbstractNode* node,
+                                 RsgAbstractNode* parent) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  priv->parents = g_slist_remove(priv->parents, parent);
+}
+
+bool rsgAbstractNodeIsShared(RsgAbstractNode* node) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  return priv->parents != NULL && priv->parents->next != NULL;
+}
+
+guint rsgAbstractNodeGetGeneration(void) {
+  return currentGeneration;
+}
+
+bool rsgAbstractNodeChangedSince(RsgAbstractNode* node, guint generation) {
   /*
-   * Map from GValue
+   * Tells whether a cache stamped with the given generation is stale. Changes
+   * within the current generation can't be ordered against the stamp, so a
+   * stamp is trusted for its own generation and picks up such changes in the
+   * next one.
    */
-  GValue value = G_VALUE_INIT;
-  g_object_get_property(G_OBJECT(node), name, &value);
-  return rsgGValueToValue(value);
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  if (generation == currentGeneration) return false;
+  return priv->dirtyGeneration >= generation;
 }
 
-void rsgNodeSetProperty(RsgNode* node, const char* name, RsgValue value) {
+void rsgAbstractNodeNotify(RsgAbstractNode* node, GParamSpec* pspec) {
+  rsgAbstractNodeMarkDirty(node);
+  rsgBindingSourceChanged(node, pspec);
+
+  // nobody listens: nothing to deliver
+  if (g_signal_has_handler_pending(node, notifySignalId,
+                                   g_param_spec_get_name_quark(pspec),
+                                   FALSE) == false)
+    return;
+
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  if (priv->notifyPending == false) {
+    priv->notifyPending = true;
+    g_object_freeze_notify(G_OBJECT(node));
+    g_ptr_array_add(pendingNotify, g_object_ref(node));
+  }
+  g_object_notify_by_pspec(G_OBJECT(node), pspec);
+}
+
+void rsgAbstractNodeFlushNotify(void) {
+  if (pendingNotify == NULL) return;  // no node was ever created
+
+  while (pendingNotify->len > 0) {
+    // swap, so that handlers queue up the next wave
+    GPtrArray* wave = pendingNotify;
+    pendingNotify = flushingNotify;
+    flushingNotify = wave;
+
+    guint i;
+    for (i = 0; i < wave->len; i++) {
+      RsgAbstractNode* node = g_ptr_array_index(wave, i);
+      RsgAbstractNodePrivate* priv =
+          rsg_abstract_node_get_instance_private(node);
+      priv->notifyPending = false;
+      g_object_thaw_notify(G_OBJECT(node));
+      g_object_unref(node);
+    }
+    g_ptr_array_set_size(wave, 0);
+  }
+}
+
+bool rsgAbstractNodeIsNotifyPending(void) {
+  return pendingNotify != NULL && pendingNotify->len > 0;
+}
+
+void rsgAbstractNodeSetPolled(RsgAbstractNode* node) {
+  RsgAbstractNodePrivate* priv = rsg_abstract_node_get_instance_private(node);
+  assert(RSG_ABSTRACT_NODE_GET_CLASS(node)->pollFunc != NULL);
+  if (priv->polled) return;
+  priv->polled = true;
+  polledNodes = g_list_prepend(polledNodes, node);
+}
+
+void rsgAbstractNodePollAll(RsgContext* ctx) {
+  GList* elem;
+  for (elem = polledNodes; elem != NULL; elem = elem->next) {
+    RsgAbstractNode* node = elem->data;
+    RSG_ABSTRACT_NODE_GET_CLASS(node)->pollFunc(node, ctx);
+  }
+}
+
+void rsgNodeMarkDirty(RsgNode* node) {
+  assert(RSG_IS_ABSTRACT_NODE(node) != false);
+  rsgAbstractNodeMarkDirty(RSG_ABSTRACT_NODE(node));
+}
+
+void rsgNodeDestroy(RsgNode* node) {
   assert(RSG_IS_ABSTRACT_NODE(node) != false);
+  RsgAbstractNodePrivate* priv =
+      rsg_abstract_node_get_instance_private(RSG_ABSTRACT_NODE(node));
+  // groups don't own their children: destroy (or leave) the groups first
+  assert(priv->parents == NULL);
+  g_object_unref(node);
+}
 
-  const char* className = g_type_name_from_instance((GTypeInstance*)node);
-  char* valStr = rsgValueToString(value);
-  printf("PROPERTY '%s' in %s: SET %s\n", name, className, valStr);
+RsgValue rsgNodeGetProperty(RsgNode* node, const char* name) {
+  const RsgProperty* prop = rsgNodeLookupProperty(node, name);
+  if (prop == NULL) return rsgValuePointer(NULL);  // warned about
+  return rsgNodeGetPropertyValue(node, prop);
+}
 
+void rsgNodeSetProperty(RsgNode* node, const char* name, RsgValue value) {
   /*
-   * Map our values to GValue
+   * Resolves the name on every call; keep the handle around instead when
+   * setting often
    */
-  GValue gvalue = rsgValueToGValue(value);
-  //  GValue gvalue = G_VALUE_INIT;
-  //  gvalue = rsgValueToGValue(value);
-  g_object_set_property(G_OBJECT(node), name, &gvalue);
-}
-
-void rsgNodeBindProperty(RsgNode* node,
-                         const char* name,
-                         RsgNode* toNode,
-                         const char* toName) {
-  assert(RSG_IS_ABSTRACT_NODE(node));
-  assert(RSG_IS_ABSTRACT_NODE(toNode));
-  (void)g_object_bind_property(G_OBJECT(node), name, G_OBJECT(toNode), toName,
-                               0);
-}
-
-void rsgNodeBindPropertyWithClosure(RsgNode* node,
-                                    const char* name,
-                                    RsgNode* toNode,
-                                    const char* toName,
-                                    RsgClosure* toTransform) {
-  assert(RSG_IS_ABSTRACT_NODE(node));
-  assert(RSG_IS_ABSTRACT_NODE(toNode));
-  assert(toTransform != NULL);
-
-  (void)g_object_bind_property_with_closures(G_OBJECT(node), name,
-                                             G_OBJECT(toNode), toName, 0,
-                                             toTransform->gclosure, NULL);
+  const RsgProperty* prop = rsgNodeLookupProperty(node, name);
+  if (prop != NULL) rsgNodeSetPropertyValue(node, prop, value);
 }
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Frame arena.
+ * Bump allocator for scratch data that lives no longer than one traversal.
+ * Allocations never fail: when the primary block is exhausted, overflow
+ * blocks are chained, and on the next reset the primary block grows to the
+ * high-water mark so a steady-state frame fits in it again. Running out of
+ * memory for a block aborts, as no caller could carry on without it.
+ */
+
+#define ARENA_ALIGN 16
+#define ARENA_ALIGN_UP(x) (((x) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct RsgArenaBlock {
+  RsgArenaBlock* next;
+  size_t size;
+  size_t used;
+};
+
+#define BLOCK_HEADER_SIZE ARENA_ALIGN_UP(sizeof(RsgArenaBlock))
+#define BLOCK_DATA(block) ((char*)(block) + BLOCK_HEADER_SIZE)
+
+static void* allocBlock(size_t size) {
+  void* mem = rsgMalloc(size);
+  if (mem == NULL)
+    g_error("Out of memory for an arena block of %zu bytes", size);
+  return mem;
+}
+
+RsgArena* rsgArenaCreate(size_t size) {
+  RsgArena* arena = allocBlock(sizeof(*arena));
+  arena->size = ARENA_ALIGN_UP(size);
+  arena->base = allocBlock(arena->size);
+  arena->used = 0;
+  arena->overflow = NULL;
+  arena->overflowUsed = 0;
+  arena->highWater = 0;
+  return arena;
+}
+
+static void freeOverflow(RsgArena* arena) {
+  while (arena->overflow != NULL) {
+    RsgArenaBlock* block = arena->overflow;
+    arena->overflow = block->next;
+    rsgFree(block);
+  }
+  arena->overflowUsed = 0;
+}
+
+void rsgArenaDestroy(RsgArena* arena) {
+  freeOverflow(arena);
+  rsgFree(arena->base);
+  rsgFree(arena);
+}
+
+void* rsgArenaAlloc(RsgArena* arena, size_t size) {
+  size = ARENA_ALIGN_UP(size);
+
+  if (arena->used + size <= arena->size) {
+    void* mem = arena->base + arena->used;
+    arena->used += size;
+    return mem;
+  }
+
+  /*
+   * Primary block is exhausted; serve from the current overflow block or
+   * chain a new one at least as big as the primary.
+   */
+  RsgArenaBlock* block = arena->overflow;
+  if (block == NULL || block->used + size > block->size) {
+    size_t blockSize = size > arena->size ? size : arena->size;
+    block = allocBlock(BLOCK_HEADER_SIZE + blockSize);
+    block->size = blockSize;
+    block->used = 0;
+    block->next = arena->overflow;
+    arena->overflow = block;
+  }
+  void* mem = BLOCK_DATA(block) + block->used;
+  block->used += size;
+  arena->overflowUsed += size;
+  return mem;
+}
+
+void rsgArenaReset(RsgArena* arena) {
+  size_t frameUsed = arena->used + arena->overflowUsed;
+  if (frameUsed > arena->highWater) arena->highWater = frameUsed;
+
+  if (arena->overflow != NULL) {
+    // grow the primary block so that a frame like this one fits in it
+    freeOverflow(arena);
+    rsgFree(arena->base);
+    arena->size = ARENA_ALIGN_UP(arena->highWater);
+    arena->base = allocBlock(arena->size);
+  }
+  arena->used = 0;
+}
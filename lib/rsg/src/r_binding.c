@@ -0,0 +1,359 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "rsg_internal.h"
+
+/*
+ * Property bindings.
+ * Bindings form a graph whose vertices are (node, property) pairs. Every
+ * vertex has a rank, larger than the ranks of all its sources, kept up to
+ * date as bindings are added (bindings that would close a cycle are
+ * refused).
+ *
+ * A change of a source property only marks the bindings out of it pending;
+ * it costs nothing more however often the property is set. Once per frame,
+ * before rendering, the pending bindings are evaluated in rank order: each
+ * reads its source, runs the optional closure and sets its target, which in
+ * turn marks the bindings downstream. Thus every binding runs at most once
+ * per frame, after all its inputs are final.
+ */
+
+typedef struct RsgBindingVertex RsgBindingVertex;
+
+typedef struct {
+  RsgBindingVertex* source;
+  RsgBindingVertex* target;
+  RsgClosure* transform;  // NULL to copy the value
+  bool pending;
+  bool dead;  // a node went away while pending; free when popped
+} RsgBinding;
+
+struct RsgBindingVertex {
+  RsgAbstractNode* node;  // NULL once the node is gone
+  const RsgProperty* prop;
+  size_t rank;
+  GPtrArray* out;  // RsgBinding*
+  GPtrArray* in;
+  size_t deadRefs;  // dead bindings still referring to the vertex
+  guint visited;    // epoch of the last walk that reached the vertex
+};
+
+static GHashTable* vertices = NULL;  // node -> GSList of RsgBindingVertex*
+
+// pending bindings, as a binary min-heap on the rank of their source
+static RsgBinding** heap = NULL;
+static size_t heapSize = 0;
+static size_t heapCapacity = 0;
+
+// graph walks are iterative, on a shared stack
+static GPtrArray* walkStack = NULL;
+static guint walkEpoch = 0;
+
+static size_t lastFrameEvaluated = 0;
+static size_t frameEvaluated = 0;
+
+static bool heapBefore(const RsgBinding* a, const RsgBinding* b) {
+  return a->source->rank < b->source->rank;
+}
+
+static void heapPush(RsgBinding* binding) {
+  if (heapSize == heapCapacity) {
+    heapCapacity = heapCapacity == 0 ? 64 : heapCapacity * 2;
+    heap = rsgRealloc(heap, heapCapacity * sizeof(*heap));
+  }
+  size_t i = heapSize++;
+  while (i > 0 && heapBefore(binding, heap[(i - 1) / 2])) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = binding;
+}
+
+static RsgBinding* heapPop(void) {
+  RsgBinding* top = heap[0];
+  RsgBinding* last = heap[--heapSize];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= heapSize) break;
+    if (child + 1 < heapSize && heapBefore(heap[child + 1], heap[child]))
+      child++;
+    if (heapBefore(heap[child], last) == false) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  if (heapSize > 0) heap[i] = last;
+  return top;
+}
+
+static void nodeGone(gpointer data, GObject* object);
+
+static RsgBindingVertex* findVertex(RsgAbstractNode* node,
+                                    const RsgProperty* prop) {
+  if (vertices == NULL) return NULL;
+
+  GSList* elem;
+  for (elem = g_hash_table_lookup(vertices, node); elem != NULL;
+       elem = elem->next) {
+    RsgBindingVertex* vertex = elem->data;
+    if (vertex->prop == prop) return vertex;
+  }
+  return NULL;
+}
+
+static RsgBindingVertex* getVertex(RsgAbstractNode* node,
+                                   const RsgProperty* prop) {
+  RsgBindingVertex* vertex = findVertex(node, prop);
+  if (vertex != NULL) return vertex;
+
+  if (vertices == NULL)
+    vertices = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  vertex = rsgMalloc(sizeof(*vertex));
+  vertex->node = node;
+  vertex->prop = prop;
+  vertex->rank = 0;
+  vertex->out = g_ptr_array_new();
+  vertex->in = g_ptr_array_new();
+  vertex->deadRefs = 0;
+  vertex->visited = 0;
+
+  GSList* list = g_hash_table_lookup(vertices, node);
+  if (list == NULL) g_object_weak_ref(G_OBJECT(node), nodeGone, NULL);
+  g_hash_table_insert(vertices, node, g_slist_prepend(list, vertex));
+  return vertex;
+}
+
+static void walkPush(RsgBindingVertex* vertex) {
+  if (walkStack == NULL) walkStack = g_ptr_array_new();
+  g_ptr_array_add(walkStack, vertex);
+}
+
+static RsgBindingVertex* walkPop(void) {
+  if (walkStack == NULL || walkStack->len == 0) return NULL;
+  RsgBindingVertex* vertex =
+      g_ptr_array_index(walkStack, walkStack->len - 1);
+  g_ptr_array_set_size(walkStack, walkStack->len - 1);
+  return vertex;
+}
+
+static bool reaches(RsgBindingVertex* from, const RsgBindingVertex* to) {
+  /*
+   * Depth-first, visiting each vertex once. Ranks grow along bindings, so
+   * vertices ranked at or above the goal can't lead to it.
+   */
+  RsgBindingVertex* vertex;
+  bool found = false;
+  walkEpoch++;
+  from->visited = walkEpoch;
+  walkPush(from);
+  while ((vertex = walkPop()) != NULL) {
+    if (vertex == to) {
+      found = true;
+      g_ptr_array_set_size(walkStack, 0);
+      break;
+    }
+    guint i;
+    for (i = 0; i < vertex->out->len; i++) {
+      RsgBindingVertex* target =
+          ((RsgBinding*)g_ptr_array_index(vertex->out, i))->target;
+      if (target->visited == walkEpoch) continue;
+      if (target != to && target->rank >= to->rank) continue;
+      target->visited = walkEpoch;
+      walkPush(target);
+    }
+  }
+  return found;
+}
+
+static void raiseRank(RsgBindingVertex* vertex, size_t rank) {
+  /*
+   * A vertex is walked again only when its rank went up, which is bounded as
+   * the graph has no cycles
+   */
+  if (vertex->rank >= rank) return;
+  vertex->rank = rank;
+  walkPush(vertex);
+  while ((vertex = walkPop()) != NULL) {
+    guint i;
+    for (i = 0; i < vertex->out->len; i++) {
+      RsgBindingVertex* target =
+          ((RsgBinding*)g_ptr_array_index(vertex->out, i))->target;
+      if (target->rank > vertex->rank) continue;
+      target->rank = vertex->rank + 1;
+      walkPush(target);
+    }
+  }
+}
+
+static void bind(RsgAbstractNode* node,
+                 const char* name,
+                 RsgAbstractNode* toNode,
+                 const char* toName,
+                 RsgClosure* transform) {
+  const RsgProperty* sourceProp = rsgNodeLookupProperty((RsgNode*)node, name);
+  const RsgProperty* targetProp =
+      rsgNodeLookupProperty((RsgNode*)toNode, toName);
+  if (sourceProp == NULL || targetProp == NULL) return;  // warned about
+
+  RsgBindingVertex* source = getVertex(node, sourceProp);
+  RsgBindingVertex* target = getVertex(toNode, targetProp);
+
+  if (reaches(target, source)) {
+    g_warning("Binding '%s' to '%s' would create a cycle; ignored", name,
+              toName);
+    return;
+  }
+
+  RsgBinding* binding = rsgMalloc(sizeof(*binding));
+  binding->source = source;
+  binding->target = target;
+  binding->transform = transform;
+  binding->pending = false;
+  binding->dead = false;
+  g_ptr_array_add(source->out, binding);
+  g_ptr_array_add(target->in, binding);
+  raiseRank(target, source->rank + 1);
+
+  // like g_object_bind_property(), sync the target right away
+  binding->pending = true;
+  heapPush(binding);
+}
+
+static void freeVertexIfOrphan(RsgBindingVertex* vertex) {
+  if (vertex->node != NULL || vertex->deadRefs > 0) return;
+  g_ptr_array_free(vertex->out, TRUE);
+  g_ptr_array_free(vertex->in, TRUE);
+  rsgFree(vertex);
+}
+
+static void unlinkBinding(RsgBinding* binding) {
+  g_ptr_array_remove_fast(binding->source->out, binding);
+  g_ptr_array_remove_fast(binding->target->in, binding);
+  if (binding->pending) {
+    // still in the heap, which orders it by its source vertex
+    binding->dead = true;
+    binding->source->deadRefs++;
+    binding->target->deadRefs++;
+  } else {
+    rsgFree(binding);
+  }
+}
+
+static void nodeGone(gpointer data, GObject* object) {
+  GSList* list = g_hash_table_lookup(vertices, object);
+  GSList* elem;
+  for (elem = list; elem != NULL; elem = elem->next) {
+    RsgBindingVertex* vertex = elem->data;
+    while (vertex->out->len > 0)
+      unlinkBinding(g_ptr_array_index(vertex->out, 0));
+    while (vertex->in->len > 0)
+      unlinkBinding(g_ptr_array_index(vertex->in, 0));
+  }
+  for (elem = list; elem != NULL; elem = elem->next) {
+    RsgBindingVertex* vertex = elem->data;
+    vertex->node = NULL;
+    freeVertexIfOrphan(vertex);
+  }
+  g_hash_table_remove(vertices, object);
+  g_slist_free(list);
+}
+
+void rsgBindingSourceChanged(RsgAbstractNode* node, GParamSpec* pspec) {
+  if (vertices == NULL || g_hash_table_size(vertices) == 0) return;
+
+  GSList* elem;
+  for (elem = g_hash_table_lookup(vertices, node); elem != NULL;
+       elem = elem->next) {
+    RsgBindingVertex* vertex = elem->data;
+    if (rsgPropertyGetPspec(vertex->prop) != pspec) continue;
+
+    guint i;
+    for (i = 0; i < vertex->out->len; i++) {
+      RsgBinding* binding = g_ptr_array_index(vertex->out, i);
+      if (binding->pending) continue;
+      binding->pending = true;
+      heapPush(binding);
+    }
+  }
+}
+
+void rsgBindingEvaluatePending(void) {
+  lastFrameEvaluated = frameEvaluated;
+  frameEvaluated = 0;
+
+  while (heapSize > 0) {
+    RsgBinding* binding = heapPop();
+    binding->pending = false;
+    if (binding->dead) {
+      binding->source->deadRefs--;
+      binding->target->deadRefs--;
+      freeVertexIfOrphan(binding->source);
+      freeVertexIfOrphan(binding->target);
+      rsgFree(binding);
+      continue;
+    }
+
+    RsgValue from = rsgNodeGetPropertyValue((RsgNode*)binding->source->node,
+                                            binding->source->prop);
+    RsgValue to = from;
+    if (binding->transform != NULL) {
+      to = (RsgValue){.type = rsgPropertyGetType(binding->target->prop)};
+      binding->transform->func(binding, &from, &to, binding->transform->data);
+    }
+    // marks the bindings out of the target pending, ranked after this one
+    rsgNodeSetPropertyValue((RsgNode*)binding->target->node,
+                            binding->target->prop, to);
+    frameEvaluated++;
+  }
+}
+
+bool rsgBindingIsPending(void) {
+  return heapSize > 0;
+}
+
+void rsgGetBindingStat(size_t* evaluated) {
+  // of the last complete frame
+  if (evaluated != NULL) *evaluated = lastFrameEvaluated;
+}
+
+void rsgNodeBindProperty(RsgNode* node,
+                         const char* name,
+                         RsgNode* toNode,
+                         const char* toName) {
+  assert(RSG_IS_ABSTRACT_NODE(node));
+  assert(RSG_IS_ABSTRACT_NODE(toNode));
+  bind(RSG_ABSTRACT_NODE(node), name, RSG_ABSTRACT_NODE(toNode), toName,
+       NULL);
+}
+
+void rsgNodeBindPropertyWithClosure(RsgNode* node,
+                                    const char* name,
+                                    RsgNode* toNode,
+                                    const char* toName,
+                                    RsgClosure* toTransform) {
+  assert(RSG_IS_ABSTRACT_NODE(node));
+  assert(RSG_IS_ABSTRACT_NODE(toNode));
+  assert(toTransform != NULL);
+  bind(RSG_ABSTRACT_NODE(node), name, RSG_ABSTRACT_NODE(toNode), toName,
+       toTransform);
+}
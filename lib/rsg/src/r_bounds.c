@@ -0,0 +1,71 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "rsg_internal.h"
+
+/*
+ * Bounding volumes and view-frustum culling.
+ * Boxes are kept as cglm AABBs (min and max corners). The frustum is
+ * extracted lazily from u_projection * u_view and cached in the local
+ * context until a camera changes either matrix.
+ */
+
+void rsgBoundsMergeTransformed(vec3s box[2],
+                               const vec3s local[2],
+                               const mat4s* model) {
+  vec3s transformed[2];
+  glms_aabb_transform((vec3s*)local, *model, transformed);
+  if (glms_aabb_isvalid(box))
+    glms_aabb_merge(box, transformed, box);
+  else {
+    box[0] = transformed[0];
+    box[1] = transformed[1];
+  }
+}
+
+bool rsgBoundsCull(RsgContext* ctx, const vec3s box[2], const mat4s* model) {
+  RsgLocalContext* lctx = ctx->local;
+  RsgCullStat* stat = &ctx->global->cull;
+
+  if (lctx->frustumValid == false) {
+    glms_frustum_planes(glms_mat4_mul(lctx->u_projection, lctx->u_view),
+                        lctx->frustum);
+    lctx->frustumValid = true;
+  }
+
+  vec3s world[2];
+  glms_aabb_transform((vec3s*)box, *model, world);
+
+  stat->tested++;
+  if (glms_aabb_frustum(world, lctx->frustum)) return false;
+  stat->culled++;
+  return true;
+}
+
+void rsgGetCullStat(size_t* tested, size_t* culled, size_t* drawn) {
+  RsgGlobalContext* gctx = rsgGetGlobalContext();
+  assert(gctx != NULL);
+  // of the last complete frame
+  if (tested != NULL) *tested = gctx->lastFrameCull.tested;
+  if (culled != NULL) *culled = gctx->lastFrameCull.culled;
+  if (drawn != NULL) *drawn = gctx->lastFrameCull.drawn;
+}
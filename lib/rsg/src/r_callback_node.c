@@ -42,7 +42,13 @@ static GParamSpec* properties[N_PROPERTIES] = {NULL};
 static void process(RsgAbstractNode* node, RsgContext* ctx) {
   RsgCallbackNode* cnode = RSG_CALLBACK_NODE(node);
   if (cnode->callbackFunc != NULL) {
+    // keep user code off the shared pool VAOs and the bound program; this
+    // is also what pipelined frames replay (RSG_PACKET_PROCESS)
+    rsgGlBindVertexArray(ctx->gl, 0);
+    rsgGlUseProgram(ctx->gl, 0);
     cnode->callbackFunc(cnode->cookie);
+    // user code may have changed anything
+    rsgGlStateInvalidate(ctx->gl);
   }
 }
 
@@ -86,8 +92,14 @@ static void get_property(GObject* object, guint property_id, GValue* value,
   }
 }
 
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  // user code may draw anything: never cull it away
+  return false;
+}
+
 static void rsg_callback_node_class_init(RsgCallbackNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
 
   G_OBJECT_CLASS(klass)->set_property = set_property;
   G_OBJECT_CLASS(klass)->get_property = get_property;
@@ -109,7 +121,6 @@ static void rsg_callback_node_class_init(RsgCallbackNodeClass* klass) {
 static void rsg_callback_node_init(RsgCallbackNode* cnode) {}
 
 RsgNode* rsgCallbackNodeCreate(void (*func)(void* cookie), void* cookie) {
-  return g_object_new(rsg_callback_node_get_type(), NULL);
-  /*  return g_object_new(rsg_callback_node_get_type(), "callback", func,
-                        "argument", cookie, NULL);*/
+  return g_object_new(rsg_callback_node_get_type(), "function", func,
+                      "cookie", cookie, NULL);
 }
@@ -123,15 +123,28 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
   /*
    * Write (modify) the OpenGL context
    */
-  glClearColor(cnode->clearColor.raw[0], cnode->clearColor.raw[1],
-               cnode->clearColor.raw[2], cnode->clearColor.raw[3]);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  rsgGlClearColor(ctx->gl, cnode->clearColor);
+  rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   /*
    * Write to the local context
    */
   ctx->local->u_projection = cnode->projectionMatrix;
   ctx->local->u_view = cnode->viewMatrix;
+  ctx->local->frustumValid = false;
+}
+
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgCameraNode* cnode = RSG_CAMERA_NODE(node);
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_CLEAR,
+                                  .node = node,
+                                  .color = &cnode->clearColor});
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_SET_PROJECTION,
+                                  .node = node,
+                                  .matrix = &cnode->projectionMatrix});
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_SET_VIEW,
+                                  .node = node,
+                                  .matrix = &cnode->viewMatrix});
 }
 
 static void set_property(GObject* object,
@@ -158,12 +171,14 @@ static void set_property(GObject* object,
       break;
     case PROP_YAW_CHANGE:
       cnode->yaw = cnode->yaw - g_value_get_float(value);
-      g_object_notify_by_pspec(object, properties[PROP_YAW_CHANGE]);
+      rsgAbstractNodeNotify(RSG_ABSTRACT_NODE(object),
+                            properties[PROP_YAW_CHANGE]);
       recalcMatrices(cnode);
       break;
     case PROP_PITCH_CHANGE:
       cnode->pitch = cnode->pitch - g_value_get_float(value);
-      g_object_notify_by_pspec(object, properties[PROP_PITCH_CHANGE]);
+      rsgAbstractNodeNotify(RSG_ABSTRACT_NODE(object),
+                            properties[PROP_PITCH_CHANGE]);
       recalcMatrices(cnode);
       break;
     default:
@@ -198,8 +213,19 @@ static void get_property(GObject* object,
   }
 }
 
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  // changes the frustum for the nodes after it: never cull it away
+  return false;
+}
+
+static void changed(RsgAbstractNode* node) {
+  recalcMatrices(RSG_CAMERA_NODE(node));
+}
+
 static void rsg_camera_node_class_init(RsgCameraNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
 
   G_OBJECT_CLASS(klass)->set_property = set_property;
   G_OBJECT_CLASS(klass)->get_property = get_property;
@@ -226,6 +252,16 @@ static void rsg_camera_node_class_init(RsgCameraNodeClass* klass) {
 
   g_object_class_install_properties(G_OBJECT_CLASS(klass), N_PROPERTIES,
                                     properties);
+
+  // plain storage for the handle-based accessors
+  rsgPropertySetStorage(properties[PROP_CLEAR_COLOR],
+                        G_STRUCT_OFFSET(RsgCameraNode, clearColor), NULL);
+  rsgPropertySetStorage(properties[PROP_POSITION],
+                        G_STRUCT_OFFSET(RsgCameraNode, position), changed);
+  rsgPropertySetStorage(properties[PROP_YAW],
+                        G_STRUCT_OFFSET(RsgCameraNode, yaw), changed);
+  rsgPropertySetStorage(properties[PROP_PITCH],
+                        G_STRUCT_OFFSET(RsgCameraNode, pitch), changed);
 }
 
 static void rsg_camera_node_init(RsgCameraNode* cnode) {}
@@ -0,0 +1,374 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Frame capture.
+ * Every presented frame is read into one of a ring of pixel buffer objects:
+ * glReadPixels into a bound GL_PIXEL_PACK_BUFFER returns at once, and the
+ * GPU makes the copy when it gets to it. A fence goes in behind the copy,
+ * and the buffer is only read back when its slot comes round again,
+ * RING_SIZE frames later; by then the fence has normally signaled and
+ * nothing waits. If it hasn't, the render thread waits for it rather than
+ * lose the frame, which is counted as a stall.
+ *
+ * Frames read back are handed to a writer thread, which streams them to a
+ * file or passes them to a callback. When the writer falls more than
+ * MAX_QUEUED frames behind (e.g. a slow disk), new frames are dropped
+ * instead of slowing down rendering.
+ *
+ * The frame size is fixed when capture starts. While the framebuffer has
+ * another size (e.g. the window was resized) frames are dropped, with a
+ * warning; stop and start again to capture at the new size.
+ *
+ * Everything but the writer runs on the render thread.
+ */
+
+#define RING_SIZE 3
+#define MAX_QUEUED 32
+#define WAIT_TIMEOUT_NS G_GINT64_CONSTANT(1000000000)
+
+typedef struct {
+  guint8* pixels;  // RGBA, bottom row first
+  size_t index;
+} Frame;
+
+typedef struct {
+  GLuint buffer;
+  GLsync fence;  // NULL while the slot holds no frame
+  size_t index;
+} Slot;
+
+typedef struct {
+  RsgCaptureFormat format;
+  FILE* file;  // or NULL when frames go to the callback
+  RsgCaptureFunc func;
+  void* cookie;
+  int width;
+  int height;
+  int fps;
+  size_t frameSize;
+  Slot ring[RING_SIZE];
+  size_t head;  // oldest slot once the ring is full
+  size_t numFrames;
+  gint queued;  // handed to the writer and not written yet
+  bool writeFailed;
+  bool resized;  // the framebuffer no longer matches width x height
+  guint8* planes;  // Y4M conversion, writer thread only
+  GThread* thread;
+  GAsyncQueue* frames;  // Frame* to write; the capture itself to quit
+  GAsyncQueue* spare;   // written Frame* to reuse
+} Capture;
+
+static Capture* capture = NULL;
+static gint numWritten = 0;
+static size_t numDropped = 0;
+static size_t numStalls = 0;
+
+/*
+ * Writer thread
+ */
+static void writeY4m(const Frame* frame) {
+  const int width = capture->width;
+  const int height = capture->height;
+  const int chromaWidth = (width + 1) / 2;
+  const int chromaHeight = (height + 1) / 2;
+  guint8* yPlane = capture->planes;
+  guint8* uPlane = yPlane + width * height;
+  guint8* vPlane = uPlane + chromaWidth * chromaHeight;
+  int x, y;
+
+  // BT.601 full range, to match the C420jpeg header; GL rows go bottom up
+  for (y = 0; y < height; y++) {
+    const guint8* row = frame->pixels + (size_t)(height - 1 - y) * width * 4;
+    for (x = 0; x < width; x++) {
+      const int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+      yPlane[y * width + x] = (guint8)((77 * r + 150 * g + 29 * b) >> 8);
+    }
+  }
+  for (y = 0; y < chromaHeight; y++) {
+    for (x = 0; x < chromaWidth; x++) {
+      // average the 2x2 block, clamped at odd edges
+      int r = 0, g = 0, b = 0, dx, dy;
+      for (dy = 0; dy < 2; dy++) {
+        const int sy = MIN(y * 2 + dy, height - 1);
+        const guint8* row =
+            frame->pixels + (size_t)(height - 1 - sy) * width * 4;
+        for (dx = 0; dx < 2; dx++) {
+          const int sx = MIN(x * 2 + dx, width - 1);
+          r += row[sx * 4];
+          g += row[sx * 4 + 1];
+          b += row[sx * 4 + 2];
+        }
+      }
+      uPlane[y * chromaWidth + x] =
+          (guint8)(((-43 * r - 85 * g + 128 * b) >> 10) + 128);
+      vPlane[y * chromaWidth + x] =
+          (guint8)(((128 * r - 107 * g - 21 * b) >> 10) + 128);
+    }
+  }
+
+  fputs("FRAME\n", capture->file);
+  fwrite(capture->planes, 1,
+         width * height + 2 * chromaWidth * chromaHeight, capture->file);
+}
+
+static void writeRaw(const Frame* frame) {
+  const size_t rowSize = (size_t)capture->width * 4;
+  int y;
+  // top row first, as raw video readers expect
+  for (y = capture->height - 1; y >= 0; y--)
+    fwrite(frame->pixels + y * rowSize, 1, rowSize, capture->file);
+}
+
+static void writeFrame(const Frame* frame) {
+  if (capture->func != NULL) {
+    capture->func(frame->pixels, capture->width, capture->height,
+                  frame->index, capture->cookie);
+    return;
+  }
+  if (capture->writeFailed) return;
+
+  if (capture->format == RSG_CAPTURE_Y4M)
+    writeY4m(frame);
+  else
+    writeRaw(frame);
+  if (ferror(capture->file)) {
+    g_warning("Capture write failed: %s; frames are discarded",
+              strerror(errno));
+    capture->writeFailed = true;
+  }
+}
+
+static gpointer writer(gpointer data) {
+  for (;;) {
+    gpointer frame = g_async_queue_pop(capture->frames);
+    if (frame == capture) break;
+    writeFrame(frame);
+    g_atomic_int_inc(&numWritten);
+    g_async_queue_push(capture->spare, frame);
+    g_atomic_int_add(&capture->queued, -1);
+  }
+  return NULL;
+}
+
+/*
+ * Readback
+ */
+static bool getFramebufferSize(int* width, int* height) {
+  const RsgGlobalContext* gctx = rsgGetGlobalContext();
+  assert(gctx != NULL);
+  if (gctx->window != NULL) {
+    glfwGetFramebufferSize(gctx->window, width, height);
+  } else if (gctx->offscreen != NULL) {
+    *width = gctx->offscreen->width;
+    *height = gctx->offscreen->height;
+  } else {
+    return false;
+  }
+  return *width > 0 && *height > 0;
+}
+
+static Frame* takeFrame(void) {
+  Frame* frame = g_async_queue_try_pop(capture->spare);
+  if (frame == NULL) {
+    frame = rsgMalloc(sizeof(*frame));
+    frame->pixels = rsgMalloc(capture->frameSize);
+  }
+  return frame;
+}
+
+/*
+ * Reads the slot's frame back from its buffer and hands it to the writer
+ */
+static void retire(Slot* slot) {
+  GLenum status =
+      rsgGl->ClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    numStalls++;
+    do {
+      status = rsgGl->ClientWaitSync(slot->fence, 0, WAIT_TIMEOUT_NS);
+    } while (status == GL_TIMEOUT_EXPIRED);
+  }
+  rsgGl->DeleteSync(slot->fence);
+  slot->fence = NULL;
+  if (status == GL_WAIT_FAILED) {
+    numDropped++;
+    return;
+  }
+
+  if (g_atomic_int_get(&capture->queued) >= MAX_QUEUED) {
+    numDropped++;
+    return;
+  }
+  Frame* frame = takeFrame();
+  frame->index = slot->index;
+  rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+  rsgGl->GetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, capture->frameSize,
+                          frame->pixels);
+  rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  g_atomic_int_inc(&capture->queued);
+  g_async_queue_push(capture->frames, frame);
+}
+
+void rsgCaptureFrame(void) {
+  if (capture == NULL) return;
+  int width, height;
+  if (getFramebufferSize(&width, &height) == false ||
+      width != capture->width || height != capture->height) {
+    // the stream and the ring are sized at start; drop until it's back
+    if (capture->resized == false)
+      g_warning("Framebuffer is %dx%d, capturing %dx%d; frames are dropped",
+                width, height, capture->width, capture->height);
+    capture->resized = true;
+    numDropped++;
+    return;
+  }
+  capture->resized = false;
+
+  Slot* slot = &capture->ring[capture->head];
+  if (slot->fence != NULL) retire(slot);
+
+  // the copy into the buffer is queued like any other GL command
+  rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+  rsgGl->ReadPixels(0, 0, capture->width, capture->height, GL_RGBA,
+                    GL_UNSIGNED_BYTE, NULL);
+  rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot->fence = rsgGl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot->index = capture->numFrames++;
+  capture->head = (capture->head + 1) % RING_SIZE;
+}
+
+/*
+ * Setup
+ */
+static bool start(FILE* file,
+                  RsgCaptureFormat format,
+                  int fps,
+                  RsgCaptureFunc func,
+                  void* cookie) {
+  assert(capture == NULL);
+  int width, height;
+  size_t i;
+  if (getFramebufferSize(&width, &height) == false) {
+    g_warning("Nothing to capture without a framebuffer");
+    return false;
+  }
+
+  capture = rsgCalloc(1, sizeof(*capture));
+  capture->format = format;
+  capture->file = file;
+  capture->func = func;
+  capture->cookie = cookie;
+  capture->width = width;
+  capture->height = height;
+  capture->fps = fps;
+  capture->frameSize = (size_t)width * height * 4;
+  for (i = 0; i < RING_SIZE; i++) {
+    Slot* slot = &capture->ring[i];
+    rsgGl->GenBuffers(1, &slot->buffer);
+    rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    rsgGl->BufferData(GL_PIXEL_PACK_BUFFER, capture->frameSize, NULL,
+                      GL_STREAM_READ);
+    slot->fence = NULL;
+  }
+  rsgGl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (file != NULL && format == RSG_CAPTURE_Y4M) {
+    // the planes of a 4:2:0 frame
+    capture->planes =
+        rsgMalloc(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+    fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height,
+            fps);
+  }
+
+  g_atomic_int_set(&numWritten, 0);
+  numDropped = 0;
+  numStalls = 0;
+  capture->frames = g_async_queue_new();
+  capture->spare = g_async_queue_new();
+  capture->thread = g_thread_new("rsg-capture", writer, NULL);
+  printf("RSG: capturing %dx%d frames\n", width, height);
+  return true;
+}
+
+/*
+ * Public API
+ */
+bool rsgCaptureStart(const char* path, RsgCaptureFormat format, int fps) {
+  assert(path != NULL);
+  assert(format != RSG_CAPTURE_Y4M || fps > 0);
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    g_warning("Can't open '%s' for capture: %s", path, strerror(errno));
+    return false;
+  }
+  if (start(file, format, fps, NULL, NULL) == false) {
+    fclose(file);
+    return false;
+  }
+  return true;
+}
+
+bool rsgCaptureStartWithCallback(RsgCaptureFunc func, void* cookie) {
+  assert(func != NULL);
+  return start(NULL, RSG_CAPTURE_RAW, 0, func, cookie);
+}
+
+void rsgCaptureStop(void) {
+  assert(capture != NULL);
+  Frame* frame;
+  size_t i;
+
+  // the last frames are still in flight
+  for (i = 0; i < RING_SIZE; i++) {
+    Slot* slot = &capture->ring[(capture->head + i) % RING_SIZE];
+    if (slot->fence != NULL) retire(slot);
+    rsgGl->DeleteBuffers(1, &slot->buffer);
+  }
+  g_async_queue_push(capture->frames, capture);
+  g_thread_join(capture->thread);
+
+  while ((frame = g_async_queue_try_pop(capture->spare)) != NULL) {
+    rsgFree(frame->pixels);
+    rsgFree(frame);
+  }
+  g_async_queue_unref(capture->frames);
+  g_async_queue_unref(capture->spare);
+  if (capture->file != NULL && fclose(capture->file) != 0)
+    g_warning("Capture write failed: %s", strerror(errno));
+  if (capture->planes != NULL) rsgFree(capture->planes);
+  rsgFree(capture);
+  capture = NULL;
+
+  printf("RSG: capture done, %d frames written, %zu dropped, %zu stalls\n",
+         g_atomic_int_get(&numWritten), numDropped, numStalls);
+}
+
+void rsgCaptureGetStat(size_t* written, size_t* dropped, size_t* stalls) {
+  if (written != NULL) *written = g_atomic_int_get(&numWritten);
+  if (dropped != NULL) *dropped = numDropped;
+  if (stalls != NULL) *stalls = numStalls;
+}
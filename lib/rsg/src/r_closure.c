@@ -29,6 +29,6 @@ RsgClosure* rsgClosureCreate(void(*func),
   RsgClosure* closure = rsgMalloc(sizeof(*closure));
   closure->data = rsgMalloc(sizeofCookie);
   memcpy(closure->data, cookie, sizeofCookie);
-  closure->gclosure = g_cclosure_new(G_CALLBACK(func), closure->data, NULL);
+  closure->func = func;
   return closure;
 }
@@ -33,22 +33,73 @@ void rsgSetGlobalContext(RsgGlobalContext* gctx) {
 
 int rsgGetScreenWidth(void) {
   assert(globalContext != NULL);
-  int width;
-  int height;
-  glfwGetWindowSize(globalContext->window, &width, &height);
+  int width = 0;
+  int height = 0;
+  if (globalContext->window != NULL)
+    glfwGetWindowSize(globalContext->window, &width, &height);
+  else if (globalContext->offscreen != NULL)
+    width = globalContext->offscreen->width;
   return width;
 }
 
 int rsgGetScreenHeight(void) {
   assert(globalContext != NULL);
-  int width;
-  int height;
-  glfwGetWindowSize(globalContext->window, &width, &height);
+  int width = 0;
+  int height = 0;
+  if (globalContext->window != NULL)
+    glfwGetWindowSize(globalContext->window, &width, &height);
+  else if (globalContext->offscreen != NULL)
+    height = globalContext->offscreen->height;
   return height;
 }
 
+void rsgSetFrameArenaSize(size_t size) {
+  assert(globalContext != NULL);
+  size_t highWater = globalContext->frameArena->highWater;
+  rsgArenaDestroy(globalContext->frameArena);
+  globalContext->frameArena = rsgArenaCreate(size);
+  globalContext->frameArena->highWater = highWater;
+}
+
+size_t rsgGetFrameArenaHighWater(void) {
+  assert(globalContext != NULL);
+  return globalContext->frameArena->highWater;
+}
+
+void rsgGetGlStateStat(size_t* issuedCalls, size_t* elidedCalls) {
+  assert(globalContext != NULL);
+  // of the last complete frame
+  if (issuedCalls != NULL)
+    *issuedCalls = globalContext->glState->lastFrameCalls;
+  if (elidedCalls != NULL)
+    *elidedCalls = globalContext->glState->lastFrameElided;
+}
+
+void rsgGetDrawStat(size_t* drawCalls, size_t* instances) {
+  assert(globalContext != NULL);
+  // of the last complete frame
+  if (drawCalls != NULL) *drawCalls = globalContext->glState->lastFrameDraws;
+  if (instances != NULL)
+    *instances = globalContext->glState->lastFrameInstances;
+}
+
+void rsgSetSwapInterval(int interval) {
+  assert(globalContext != NULL);
+  if (globalContext->window != NULL) glfwSwapInterval(interval);
+}
+
+void rsgGetFrameDeadlineStat(size_t* frames, size_t* missed) {
+  assert(globalContext != NULL);
+  // of the current or last immediate mode main loop
+  if (frames != NULL) *frames = globalContext->scheduler.frames;
+  if (missed != NULL) *missed = globalContext->scheduler.missed;
+}
+
 void rsgLocalContextReset(RsgLocalContext* lctx) {
-  lctx->program = 0;
+  lctx->program = NULL;
+  lctx->u_model = glms_mat4_identity();
+  lctx->modelGeneration = 0;
   lctx->u_projection = glms_mat4_identity();
   lctx->u_view = glms_mat4_identity();
+  lctx->frustumValid = false;
 }
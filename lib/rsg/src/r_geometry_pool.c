@@ -0,0 +1,408 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Geometry pool.
+ * The vertices and indices of all meshes are sub-allocated from one vertex
+ * buffer and one element buffer per vertex layout, both attached to a VAO
+ * of that layout. Draws pick their range with the index offset and the
+ * base vertex (glDrawElementsBaseVertex), so drawing different meshes of a
+ * layout never switches the VAO or the buffers.
+ *
+ * Each buffer is managed as a heap of fixed-size units (a vertex, or 4
+ * bytes of indices) with a first-fit free list, kept sorted by offset, in
+ * which freed ranges are merged with their neighbours. A heap that can't
+ * satisfy an allocation grows: the buffer is replaced by one twice as
+ * large and the contents are copied on the GPU. Offsets stay valid, so
+ * only the VAO needs updating.
+ *
+ * Compaction packs the live geometries of a layout into a new buffer of
+ * the size they need, which closes the holes left by freed geometries.
+ * As draws refer to their geometry rather than copying its offsets, the
+ * geometry structs are simply updated in place.
+ *
+ * Everything here runs on the render thread between traversals, where the
+ * GL state tracker doesn't rely on the current bindings.
+ */
+
+#define NUM_LAYOUTS ((RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS) + 1)
+#define INITIAL_SIZE (1024 * 1024)  // bytes
+#define INDEX_UNIT 4                // bytes
+
+typedef struct {
+  size_t offset;  // units
+  size_t size;
+} Range;
+
+typedef struct {
+  GLenum target;
+  GLuint buffer;
+  size_t unit;  // bytes
+  size_t capacity;  // units
+  size_t used;
+  GArray* holes;  // Range, sorted by offset; includes the free tail
+} Heap;
+
+typedef struct {
+  GLuint vao;
+  Heap vertices;
+  Heap indices;
+  GPtrArray* geometries;  // live ones
+} Pool;
+
+static Pool* pools[NUM_LAYOUTS];
+
+/*
+ * Heaps
+ */
+static void heapInit(Heap* heap, GLenum target, size_t unit) {
+  heap->target = target;
+  heap->unit = unit;
+  heap->capacity = MAX(INITIAL_SIZE / unit, 1);
+  heap->used = 0;
+  heap->holes = g_array_new(FALSE, FALSE, sizeof(Range));
+  Range all = {0, heap->capacity};
+  g_array_append_val(heap->holes, all);
+
+  rsgGl->GenBuffers(1, &heap->buffer);
+  rsgGl->BindBuffer(target, heap->buffer);
+  rsgGl->BufferData(target, heap->capacity * unit, NULL, GL_STATIC_DRAW);
+}
+
+static void heapFree(Heap* heap, size_t offset, size_t size) {
+  GArray* holes = heap->holes;
+  guint i;
+  guint lo = 0;
+  guint hi = holes->len;
+  if (size == 0) return;
+  heap->used -= size;
+
+  // first hole after the range
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+    if (g_array_index(holes, Range, mid).offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  i = lo;
+
+  bool mergePrev =
+      i > 0 && g_array_index(holes, Range, i - 1).offset +
+                       g_array_index(holes, Range, i - 1).size ==
+                   offset;
+  bool mergeNext =
+      i < holes->len && offset + size == g_array_index(holes, Range, i).offset;
+  if (mergePrev && mergeNext) {
+    g_array_index(holes, Range, i - 1).size +=
+        size + g_array_index(holes, Range, i).size;
+    g_array_remove_index(holes, i);
+  } else if (mergePrev) {
+    g_array_index(holes, Range, i - 1).size += size;
+  } else if (mergeNext) {
+    g_array_index(holes, Range, i).offset = offset;
+    g_array_index(holes, Range, i).size += size;
+  } else {
+    Range hole = {offset, size};
+    g_array_insert_val(holes, i, hole);
+  }
+}
+
+/*
+ * Replaces the buffer with a larger one, keeping the contents at their
+ * offsets; returns the old buffer, for the caller to delete once the VAO
+ * no longer refers to it
+ */
+static GLuint heapGrow(Heap* heap, size_t minCapacity) {
+  size_t oldCapacity = heap->capacity;
+  GLuint oldBuffer = heap->buffer;
+  size_t capacity = oldCapacity;
+  while (capacity < minCapacity) capacity *= 2;
+
+  rsgGl->GenBuffers(1, &heap->buffer);
+  rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, heap->buffer);
+  rsgGl->BufferData(GL_COPY_WRITE_BUFFER, capacity * heap->unit, NULL,
+                    GL_STATIC_DRAW);
+  rsgGl->BindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+  rsgGl->CopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                           oldCapacity * heap->unit);
+  heap->capacity = capacity;
+  // the new space goes to the end, merged with a free tail
+  heap->used += capacity - oldCapacity;
+  heapFree(heap, oldCapacity, capacity - oldCapacity);
+  return oldBuffer;
+}
+
+/*
+ * First fit; returns false if no hole is large enough
+ */
+static bool heapAlloc(Heap* heap, size_t size, size_t* offset) {
+  GArray* holes = heap->holes;
+  guint i;
+  for (i = 0; i < holes->len; i++) {
+    Range* hole = &g_array_index(holes, Range, i);
+    if (hole->size < size) continue;
+    *offset = hole->offset;
+    hole->offset += size;
+    hole->size -= size;
+    if (hole->size == 0) g_array_remove_index(holes, i);
+    heap->used += size;
+    return true;
+  }
+  return false;
+}
+
+static size_t heapGetFreeTail(const Heap* heap) {
+  const GArray* holes = heap->holes;
+  if (holes->len == 0) return 0;
+  const Range* last = &g_array_index(holes, Range, holes->len - 1);
+  return last->offset + last->size == heap->capacity ? last->size : 0;
+}
+
+/*
+ * Pools
+ */
+static void setupVertexArray(Pool* pool, int layout) {
+  const RsgMeshData probe = {.layout = layout};
+  const GLsizei stride = rsgMeshDataGetStride(&probe) * sizeof(GLfloat);
+  size_t offset = 0;
+
+  rsgGl->BindVertexArray(pool->vao);
+  rsgGl->BindBuffer(GL_ARRAY_BUFFER, pool->vertices.buffer);
+  rsgGl->EnableVertexAttribArray(RSG_ATTRIB_POSITION);
+  rsgGl->VertexAttribPointer(RSG_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE,
+                             stride, 0);
+  offset += 3 * sizeof(GLfloat);
+  if (layout & RSG_MESH_NORMALS) {
+    rsgGl->EnableVertexAttribArray(RSG_ATTRIB_NORMAL);
+    rsgGl->VertexAttribPointer(RSG_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE,
+                               stride, (void*)offset);
+    offset += 3 * sizeof(GLfloat);
+  }
+  if (layout & RSG_MESH_TEXCOORDS) {
+    rsgGl->EnableVertexAttribArray(RSG_ATTRIB_TEXCOORD);
+    rsgGl->VertexAttribPointer(RSG_ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE,
+                               stride, (void*)offset);
+  }
+  rsgGl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->indices.buffer);
+  rsgGl->BindVertexArray(0);
+  // bind calls stored in the VAO
+  rsgGl->BindBuffer(GL_ARRAY_BUFFER, 0);
+  rsgGl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static Pool* getPool(int layout) {
+  if (pools[layout] != NULL) return pools[layout];
+
+  const RsgMeshData probe = {.layout = layout};
+  Pool* pool = rsgMalloc(sizeof(*pool));
+  rsgGl->GenVertexArrays(1, &pool->vao);
+  heapInit(&pool->vertices, GL_ARRAY_BUFFER,
+           rsgMeshDataGetStride(&probe) * sizeof(GLfloat));
+  heapInit(&pool->indices, GL_ELEMENT_ARRAY_BUFFER, INDEX_UNIT);
+  pool->geometries = g_ptr_array_new();
+  setupVertexArray(pool, layout);
+  pools[layout] = pool;
+  return pool;
+}
+
+/*
+ * Allocates from the heap, growing it if needed
+ */
+static size_t allocate(Pool* pool, int layout, Heap* heap, size_t size) {
+  size_t offset;
+  if (heapAlloc(heap, size, &offset)) return offset;
+
+  // whatever is free at the end is extended
+  GLuint oldBuffer =
+      heapGrow(heap, heap->capacity - heapGetFreeTail(heap) + size);
+  setupVertexArray(pool, layout);
+  rsgGl->DeleteBuffers(1, &oldBuffer);
+  heapAlloc(heap, size, &offset);  // fits now
+  return offset;
+}
+
+/*
+ * Copies the ranges of the live geometries into a new buffer, one after
+ * another, and returns the old buffer
+ */
+static GLuint compactHeap(Pool* pool, Heap* heap, bool vertices) {
+  GLuint oldBuffer = heap->buffer;
+  size_t capacity = MAX(heap->used + heap->used / 4, INITIAL_SIZE / heap->unit);
+  size_t offset = 0;
+  guint i;
+
+  rsgGl->GenBuffers(1, &heap->buffer);
+  rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, heap->buffer);
+  rsgGl->BufferData(GL_COPY_WRITE_BUFFER, capacity * heap->unit, NULL,
+                    GL_STATIC_DRAW);
+  rsgGl->BindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+  for (i = 0; i < pool->geometries->len; i++) {
+    RsgGeometry* geometry = g_ptr_array_index(pool->geometries, i);
+    size_t from, size;
+    if (vertices) {
+      from = geometry->baseVertex;
+      size = geometry->numVertices;
+      geometry->baseVertex = (GLint)offset;
+    } else {
+      from = geometry->indexOffset / INDEX_UNIT;
+      size = geometry->indexUnits;
+      geometry->indexOffset = offset * INDEX_UNIT;
+    }
+    rsgGl->CopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                             from * heap->unit, offset * heap->unit,
+                             size * heap->unit);
+    offset += size;
+  }
+
+  heap->capacity = capacity;
+  heap->used = capacity;
+  g_array_set_size(heap->holes, 0);
+  heapFree(heap, offset, capacity - offset);
+  return oldBuffer;
+}
+
+/*
+ * Internal API
+ */
+RsgGeometry* rsgGeometryCreate(const RsgMeshData* data) {
+  assert(data->numIndices <= G_MAXINT32);
+  assert(data->numVertices <= G_MAXINT32);
+  Pool* pool = getPool(data->layout);
+  const size_t indexBytes = data->numIndices * rsgMeshDataGetIndexSize(data);
+  RsgGeometry* geometry = rsgMalloc(sizeof(*geometry));
+
+  geometry->vao = pool->vao;
+  geometry->count = (GLsizei)data->numIndices;
+  geometry->indexType = data->indexType;
+  geometry->layout = data->layout;
+  geometry->numVertices = data->numVertices;
+  geometry->indexUnits = (indexBytes + INDEX_UNIT - 1) / INDEX_UNIT;
+  geometry->baseVertex = (GLint)allocate(pool, data->layout, &pool->vertices,
+                                         data->numVertices);
+  geometry->indexOffset =
+      allocate(pool, data->layout, &pool->indices, geometry->indexUnits) *
+      INDEX_UNIT;
+  geometry->slot = pool->geometries->len;
+  geometry->refCount = 1;
+  g_ptr_array_add(pool->geometries, geometry);
+
+  rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, pool->vertices.buffer);
+  rsgGl->BufferSubData(GL_COPY_WRITE_BUFFER,
+                       geometry->baseVertex * pool->vertices.unit,
+                       data->numVertices * pool->vertices.unit,
+                       data->vertices);
+  rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, pool->indices.buffer);
+  rsgGl->BufferSubData(GL_COPY_WRITE_BUFFER, geometry->indexOffset,
+                       indexBytes, data->indices);
+  rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return geometry;
+}
+
+RsgGeometry* rsgGeometryRef(RsgGeometry* geometry) {
+  geometry->refCount++;
+  return geometry;
+}
+
+void rsgGeometryUnref(RsgGeometry* geometry) {
+  assert(geometry->refCount > 0);
+  if (--geometry->refCount > 0) return;
+
+  Pool* pool = pools[geometry->layout];
+  heapFree(&pool->vertices, geometry->baseVertex, geometry->numVertices);
+  heapFree(&pool->indices, geometry->indexOffset / INDEX_UNIT,
+           geometry->indexUnits);
+
+  // the last geometry takes its slot
+  RsgGeometry* last =
+      g_ptr_array_index(pool->geometries, pool->geometries->len - 1);
+  g_ptr_array_index(pool->geometries, geometry->slot) = last;
+  last->slot = geometry->slot;
+  g_ptr_array_set_size(pool->geometries, pool->geometries->len - 1);
+  rsgFree(geometry);
+}
+
+/*
+ * Public API
+ */
+void rsgGeometryPoolCompact(void) {
+  int layout;
+  for (layout = 0; layout < NUM_LAYOUTS; layout++) {
+    Pool* pool = pools[layout];
+    if (pool == NULL) continue;
+    GLuint oldBuffers[2] = {compactHeap(pool, &pool->vertices, true),
+                            compactHeap(pool, &pool->indices, false)};
+    setupVertexArray(pool, layout);
+    rsgGl->BindBuffer(GL_COPY_READ_BUFFER, 0);
+    rsgGl->BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    rsgGl->DeleteBuffers(2, oldBuffers);
+  }
+}
+
+void rsgGeometryPoolGetStat(size_t* usedBytes,
+                            size_t* capacityBytes,
+                            size_t* numGeometries,
+                            size_t* numHoles) {
+  size_t used = 0, capacity = 0, geometries = 0, holes = 0;
+  int layout;
+  for (layout = 0; layout < NUM_LAYOUTS; layout++) {
+    const Pool* pool = pools[layout];
+    if (pool == NULL) continue;
+    used += pool->vertices.used * pool->vertices.unit +
+            pool->indices.used * pool->indices.unit;
+    capacity += pool->vertices.capacity * pool->vertices.unit +
+                pool->indices.capacity * pool->indices.unit;
+    geometries += pool->geometries->len;
+    // the free tail isn't a hole
+    holes += pool->vertices.holes->len - (heapGetFreeTail(&pool->vertices) > 0);
+    holes += pool->indices.holes->len - (heapGetFreeTail(&pool->indices) > 0);
+  }
+  if (usedBytes != NULL) *usedBytes = used;
+  if (capacityBytes != NULL) *capacityBytes = capacity;
+  if (numGeometries != NULL) *numGeometries = geometries;
+  if (numHoles != NULL) *numHoles = holes;
+}
+
+void rsgGeometryPoolPrintStat(void) {
+  static const char* layoutNames[NUM_LAYOUTS] = {
+      "position", "position+normal", "position+texcoord",
+      "position+normal+texcoord"};
+  int layout;
+  printf("Geometry pool:\n");
+  for (layout = 0; layout < NUM_LAYOUTS; layout++) {
+    const Pool* pool = pools[layout];
+    if (pool == NULL) continue;
+    printf("  %-26s %u geometries\n", layoutNames[layout],
+           pool->geometries->len);
+    printf("    vertices %zu of %zu KiB in use, %u free ranges\n",
+           pool->vertices.used * pool->vertices.unit / 1024,
+           pool->vertices.capacity * pool->vertices.unit / 1024,
+           pool->vertices.holes->len);
+    printf("    indices  %zu of %zu KiB in use, %u free ranges\n",
+           pool->indices.used * pool->indices.unit / 1024,
+           pool->indices.capacity * pool->indices.unit / 1024,
+           pool->indices.holes->len);
+  }
+}
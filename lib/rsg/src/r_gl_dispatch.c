@@ -0,0 +1,592 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "rsg_internal.h"
+
+/*
+ * GL dispatch.
+ * The real backend calls the GL entry points of the current context, as
+ * resolved by the window system (GLFW or EGL). The null backend
+ * makes GL free, to measure the CPU cost alone: calls do nothing, objects
+ * get made-up names, and shaders compile and link without ever failing.
+ *
+ * A recording sits in front of either of them. It counts the calls per
+ * entry point and optionally keeps the call stream along with any client
+ * memory the calls read (buffer data, uniform and attribute values), so the
+ * stream can be replayed later.
+ */
+
+static RsgGl realGl;
+static bool realTimerQuery = false;
+static RsgGl nullGl;
+static RsgGl recordingGl;
+static const RsgGl* backend = &nullGl;  // real or null
+const RsgGl* rsgGl = &nullGl;
+
+/*
+ * Null backend
+ */
+static GLuint nullNames = 0;
+
+#define NULL_VOID(name, params) \
+  static void GLAPIENTRY null##name params {}
+#define NULL_GEN(name)                                          \
+  static void GLAPIENTRY null##name(GLsizei n, GLuint* names) { \
+    GLsizei i;                                                  \
+    for (i = 0; i < n; i++) names[i] = ++nullNames;             \
+  }
+#define NULL_GET_INFO_LOG(name)                                               \
+  static void GLAPIENTRY null##name(GLuint object, GLsizei bufSize,           \
+                                    GLsizei* length, GLchar* infoLog) {       \
+    if (length != NULL) *length = 0;                                          \
+    if (bufSize > 0) infoLog[0] = '\0';                                       \
+  }
+
+NULL_VOID(ActiveTexture, (GLenum texture))
+NULL_VOID(AttachShader, (GLuint program, GLuint shader))
+NULL_VOID(BindBuffer, (GLenum target, GLuint buffer))
+NULL_VOID(BindFramebuffer, (GLenum target, GLuint framebuffer))
+NULL_VOID(BindRenderbuffer, (GLenum target, GLuint renderbuffer))
+NULL_VOID(BindTexture, (GLenum target, GLuint texture))
+NULL_VOID(BindVertexArray, (GLuint array))
+NULL_VOID(BlendFunc, (GLenum sfactor, GLenum dfactor))
+NULL_VOID(BufferData,
+          (GLenum target, GLsizeiptr size, const void* data, GLenum usage))
+NULL_VOID(BufferSubData,
+          (GLenum target, GLintptr offset, GLsizeiptr size, const void* data))
+NULL_VOID(Clear, (GLbitfield mask))
+NULL_VOID(ClearColor,
+          (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha))
+NULL_VOID(CompileShader, (GLuint shader))
+NULL_VOID(CopyBufferSubData,
+          (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
+           GLintptr writeOffset, GLsizeiptr size))
+NULL_VOID(DeleteBuffers, (GLsizei n, const GLuint* buffers))
+NULL_VOID(DeleteFramebuffers, (GLsizei n, const GLuint* framebuffers))
+NULL_VOID(DeleteProgram, (GLuint program))
+NULL_VOID(DeleteRenderbuffers, (GLsizei n, const GLuint* renderbuffers))
+NULL_VOID(DeleteShader, (GLuint shader))
+NULL_VOID(DeleteSync, (GLsync sync))
+NULL_VOID(DepthFunc, (GLenum func))
+NULL_VOID(Disable, (GLenum cap))
+NULL_VOID(DisableVertexAttribArray, (GLuint index))
+NULL_VOID(DrawElements,
+          (GLenum mode, GLsizei count, GLenum type, const void* indices))
+NULL_VOID(DrawElementsBaseVertex,
+          (GLenum mode, GLsizei count, GLenum type, const void* indices,
+           GLint basevertex))
+NULL_VOID(DrawElementsInstanced,
+          (GLenum mode, GLsizei count, GLenum type, const void* indices,
+           GLsizei instancecount))
+NULL_VOID(DrawElementsInstancedBaseVertex,
+          (GLenum mode, GLsizei count, GLenum type, const void* indices,
+           GLsizei instancecount, GLint basevertex))
+NULL_VOID(Enable, (GLenum cap))
+NULL_VOID(EnableVertexAttribArray, (GLuint index))
+NULL_VOID(FramebufferRenderbuffer,
+          (GLenum target, GLenum attachment, GLenum renderbuffertarget,
+           GLuint renderbuffer))
+NULL_GEN(GenBuffers)
+NULL_GEN(GenFramebuffers)
+NULL_GEN(GenQueries)
+NULL_GEN(GenRenderbuffers)
+NULL_GEN(GenVertexArrays)
+NULL_GET_INFO_LOG(GetProgramInfoLog)
+NULL_GET_INFO_LOG(GetShaderInfoLog)
+NULL_VOID(LinkProgram, (GLuint program))
+NULL_VOID(QueryCounter, (GLuint id, GLenum target))
+NULL_VOID(ReadPixels,
+          (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,
+           GLenum type, void* pixels))
+NULL_VOID(RenderbufferStorage,
+          (GLenum target, GLenum internalformat, GLsizei width,
+           GLsizei height))
+NULL_VOID(ShaderSource,
+          (GLuint shader, GLsizei count, const GLchar* const* string,
+           const GLint* length))
+NULL_VOID(UniformMatrix4fv,
+          (GLint location, GLsizei count, GLboolean transpose,
+           const GLfloat* value))
+NULL_VOID(UseProgram, (GLuint program))
+NULL_VOID(ValidateProgram, (GLuint program))
+NULL_VOID(VertexAttrib4fv, (GLuint index, const GLfloat* v))
+NULL_VOID(VertexAttribDivisor, (GLuint index, GLuint divisor))
+NULL_VOID(VertexAttribPointer,
+          (GLuint index, GLint size, GLenum type, GLboolean normalized,
+           GLsizei stride, const void* pointer))
+NULL_VOID(Viewport, (GLint x, GLint y, GLsizei width, GLsizei height))
+
+static GLenum GLAPIENTRY nullCheckFramebufferStatus(GLenum target) {
+  return GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLenum GLAPIENTRY nullClientWaitSync(GLsync sync,
+                                           GLbitfield flags,
+                                           GLuint64 timeout) {
+  return GL_ALREADY_SIGNALED;
+}
+
+static GLuint GLAPIENTRY nullCreateProgram(void) {
+  return ++nullNames;
+}
+
+static GLuint GLAPIENTRY nullCreateShader(GLenum type) {
+  return ++nullNames;
+}
+
+static GLsync GLAPIENTRY nullFenceSync(GLenum condition, GLbitfield flags) {
+  return (GLsync)(guintptr)++nullNames;
+}
+
+// buffers have no contents
+static void GLAPIENTRY nullGetBufferSubData(GLenum target,
+                                            GLintptr offset,
+                                            GLsizeiptr size,
+                                            void* data) {
+  memset(data, 0, size);
+}
+
+// programs have no active uniforms, but any name resolves
+static void GLAPIENTRY nullGetActiveUniform(GLuint program,
+                                            GLuint index,
+                                            GLsizei bufSize,
+                                            GLsizei* length,
+                                            GLint* size,
+                                            GLenum* type,
+                                            GLchar* name) {}
+
+// attributes bound by name before linking land where they were bound, as
+// with a real linker; other names resolve to 0
+#define NULL_MAX_BOUND_ATTRIBS 8
+
+static struct {
+  const GLchar* name;
+  GLuint index;
+} nullBoundAttribs[NULL_MAX_BOUND_ATTRIBS];
+static size_t nullNumBoundAttribs = 0;
+
+static void GLAPIENTRY nullBindAttribLocation(GLuint program,
+                                              GLuint index,
+                                              const GLchar* name) {
+  size_t i;
+  for (i = 0; i < nullNumBoundAttribs; i++) {
+    if (strcmp(nullBoundAttribs[i].name, name) == 0) {
+      nullBoundAttribs[i].index = index;
+      return;
+    }
+  }
+  if (nullNumBoundAttribs == NULL_MAX_BOUND_ATTRIBS) return;
+  // the names bound are string literals
+  nullBoundAttribs[nullNumBoundAttribs].name = name;
+  nullBoundAttribs[nullNumBoundAttribs].index = index;
+  nullNumBoundAttribs++;
+}
+
+static GLint GLAPIENTRY nullGetAttribLocation(GLuint program,
+                                              const GLchar* name) {
+  size_t i;
+  for (i = 0; i < nullNumBoundAttribs; i++) {
+    if (strcmp(nullBoundAttribs[i].name, name) == 0)
+      return (GLint)nullBoundAttribs[i].index;
+  }
+  return 0;
+}
+
+static GLint GLAPIENTRY nullGetUniformLocation(GLuint program,
+                                               const GLchar* name) {
+  return 0;
+}
+
+static void GLAPIENTRY nullGetIntegerv(GLenum pname, GLint* data) {
+  *data = 0;
+}
+
+static void GLAPIENTRY nullGetObjectiv(GLuint object,
+                                       GLenum pname,
+                                       GLint* params) {
+  switch (pname) {
+    case GL_COMPILE_STATUS:
+    case GL_LINK_STATUS:
+    case GL_VALIDATE_STATUS:
+    case GL_QUERY_RESULT_AVAILABLE:
+      *params = GL_TRUE;
+      break;
+    default:
+      *params = 0;
+  }
+}
+
+static void GLAPIENTRY nullGetQueryObjectui64v(GLuint id,
+                                               GLenum pname,
+                                               GLuint64* params) {
+  *params = 0;
+}
+
+#define nullGetProgramiv nullGetObjectiv
+#define nullGetQueryObjectiv nullGetObjectiv
+#define nullGetShaderiv nullGetObjectiv
+
+/*
+ * Recording backend
+ */
+typedef enum {
+#define ENUM_ENTRY(ret, name, params, args) RSG_GL_##name,
+  RSG_GL_FUNCTIONS(ENUM_ENTRY)
+#undef ENUM_ENTRY
+  RSG_GL_NUM_FUNCTIONS
+} RsgGlFunction;
+
+static const char* functionNames[RSG_GL_NUM_FUNCTIONS] = {
+#define NAME_ENTRY(ret, name, params, args) "gl" #name,
+    RSG_GL_FUNCTIONS(NAME_ENTRY)
+#undef NAME_ENTRY
+};
+
+#define MAX_ARGS 7
+
+/*
+ * A recorded call: arguments are stored as their bytes. Pointers to client
+ * memory that the call reads are replaced by offsets into the recording's
+ * data.
+ */
+typedef struct {
+  RsgGlFunction function;
+  guint64 args[MAX_ARGS];
+} RsgGlCall;
+
+struct RsgGlRecording {
+  size_t counts[RSG_GL_NUM_FUNCTIONS];
+  bool keepCalls;
+  GArray* calls;
+  GByteArray* data;
+};
+
+static RsgGlRecording* recording = NULL;
+
+static RsgGlCall* record(RsgGlFunction function) {
+  recording->counts[function]++;
+  if (recording->keepCalls == false) return NULL;
+
+  RsgGlCall call;
+  call.function = function;
+  g_array_append_val(recording->calls, call);
+  return &g_array_index(recording->calls, RsgGlCall, recording->calls->len - 1);
+}
+
+static void packArg(RsgGlCall* call, int index, const void* arg, size_t size) {
+  assert(size <= sizeof(call->args[0]));
+  call->args[index] = 0;
+  memcpy(&call->args[index], arg, size);
+}
+
+static void packData(RsgGlCall* call,
+                     int index,
+                     const void* data,
+                     size_t size) {
+  guint64 offset = recording->data->len;
+  g_byte_array_append(recording->data, data, (guint)size);
+  call->args[index] = offset;
+}
+
+#define ARG(call, index, type) (*(const type*)&(call)->args[index])
+#define DATA(rec, call, index) (rec->data->data + (call)->args[index])
+
+static void captureData(RsgGlCall* call) {
+  switch (call->function) {
+    case RSG_GL_BufferData:
+      if (ARG(call, 2, void*) != NULL)
+        packData(call, 2, ARG(call, 2, void*), ARG(call, 1, GLsizeiptr));
+      break;
+    case RSG_GL_BufferSubData:
+      packData(call, 3, ARG(call, 3, void*), ARG(call, 2, GLsizeiptr));
+      break;
+    case RSG_GL_UniformMatrix4fv:
+      packData(call, 3, ARG(call, 3, GLfloat*),
+               ARG(call, 1, GLsizei) * 16 * sizeof(GLfloat));
+      break;
+    case RSG_GL_VertexAttrib4fv:
+      packData(call, 1, ARG(call, 1, GLfloat*), 4 * sizeof(GLfloat));
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Wrappers that record the call, then make it through the backend
+ */
+#define NARGS(...) NARGS_(_, ##__VA_ARGS__, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NARGS_(_, a1, a2, a3, a4, a5, a6, a7, n, ...) n
+#define PACK(i, a) packArg(call, i, &(a), sizeof(a));
+#define PACK_0()
+#define PACK_1(a) PACK(0, a)
+#define PACK_2(a, b) PACK_1(a) PACK(1, b)
+#define PACK_3(a, b, c) PACK_2(a, b) PACK(2, c)
+#define PACK_4(a, b, c, d) PACK_3(a, b, c) PACK(3, d)
+#define PACK_5(a, b, c, d, e) PACK_4(a, b, c, d) PACK(4, e)
+#define PACK_6(a, b, c, d, e, f) PACK_5(a, b, c, d, e) PACK(5, f)
+#define PACK_7(a, b, c, d, e, f, g) PACK_6(a, b, c, d, e, f) PACK(6, g)
+#define PACK_N_(n) PACK_##n
+#define PACK_N(n) PACK_N_(n)
+#define PACK_ARGS(...) PACK_N(NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define RECORD(name, args)                 \
+  RsgGlCall* call = record(RSG_GL_##name); \
+  if (call != NULL) {                      \
+    PACK_ARGS args                         \
+    captureData(call);                     \
+  }
+#define RECORD_void(name, args) \
+  RECORD(name, args)            \
+  backend->name args;
+#define RECORD_GLint(name, args) \
+  RECORD(name, args)             \
+  return backend->name args;
+#define RECORD_GLuint RECORD_GLint
+#define RECORD_GLenum RECORD_GLint
+#define RECORD_GLsync RECORD_GLint
+
+#define RECORDING_WRAPPER(ret, name, params, args) \
+  static ret GLAPIENTRY recording##name params {   \
+    RECORD_##ret(name, args)                       \
+  }
+RSG_GL_FUNCTIONS(RECORDING_WRAPPER)
+#undef RECORDING_WRAPPER
+
+/*
+ * Setup
+ */
+/*
+ * Sets up the backends; with getProcAddress, the real one is selected.
+ */
+void rsgGlDispatchInit(RsgGlProc (*getProcAddress)(const char* name)) {
+#define NULL_ENTRY(ret, name, params, args) nullGl.name = null##name;
+#define RECORDING_ENTRY(ret, name, params, args) \
+  recordingGl.name = recording##name;
+  RSG_GL_FUNCTIONS(NULL_ENTRY)
+  RSG_GL_FUNCTIONS(RECORDING_ENTRY)
+#undef NULL_ENTRY
+#undef RECORDING_ENTRY
+
+  if (getProcAddress != NULL) {
+#define REAL_ENTRY(ret, name, params, args) \
+  realGl.name = (ret(GLAPIENTRY*) params)getProcAddress("gl" #name);
+    RSG_GL_FUNCTIONS(REAL_ENTRY)
+#undef REAL_ENTRY
+    // timer queries are core in 3.3 (GL_MAJOR_VERSION itself in 3.0)
+    GLint major = 0;
+    GLint minor = 0;
+    realGl.GetIntegerv(GL_MAJOR_VERSION, &major);
+    realGl.GetIntegerv(GL_MINOR_VERSION, &minor);
+    realTimerQuery = major > 3 || (major == 3 && minor >= 3);
+    backend = &realGl;
+  } else {
+    backend = &nullGl;
+  }
+  rsgGl = backend;
+}
+
+bool rsgGlHasTimerQuery(void) {
+  return backend == &realGl && realTimerQuery;
+}
+
+/*
+ * Public API
+ */
+void rsgGlSetNullBackend(bool value) {
+  // the real backend stays unavailable without a display
+  if (value == false && realGl.Clear == NULL) return;
+  backend = value ? &nullGl : &realGl;
+  if (recording == NULL) rsgGl = backend;
+}
+
+void rsgGlRecordingStart(bool keepCalls) {
+  assert(recording == NULL);
+  recording = rsgCalloc(1, sizeof(*recording));
+  recording->keepCalls = keepCalls;
+  recording->calls = g_array_new(FALSE, FALSE, sizeof(RsgGlCall));
+  recording->data = g_byte_array_new();
+  rsgGl = &recordingGl;
+}
+
+RsgGlRecording* rsgGlRecordingStop(void) {
+  RsgGlRecording* rec = recording;
+  assert(rec != NULL);
+  recording = NULL;
+  rsgGl = backend;
+  return rec;
+}
+
+void rsgGlRecordingDestroy(RsgGlRecording* rec) {
+  g_array_free(rec->calls, TRUE);
+  g_byte_array_free(rec->data, TRUE);
+  rsgFree(rec);
+}
+
+size_t rsgGlRecordingGetNumCalls(const RsgGlRecording* rec,
+                                 const char* name) {
+  size_t total = 0;
+  int i;
+  for (i = 0; i < RSG_GL_NUM_FUNCTIONS; i++) {
+    if (name == NULL || strcmp(name, functionNames[i]) == 0)
+      total += rec->counts[i];
+  }
+  return total;
+}
+
+void rsgGlRecordingPrint(const RsgGlRecording* rec) {
+  guint i;
+  printf("GL calls recorded: %zu\n", rsgGlRecordingGetNumCalls(rec, NULL));
+  for (i = 0; i < RSG_GL_NUM_FUNCTIONS; i++) {
+    if (rec->counts[i] > 0)
+      printf("  %-28s %zu\n", functionNames[i], rec->counts[i]);
+  }
+  if (rec->keepCalls == false) return;
+
+  printf("Call stream:\n");
+  for (i = 0; i < rec->calls->len; i++) {
+    const RsgGlCall* call = &g_array_index(rec->calls, RsgGlCall, i);
+    printf("  %s(0x%" G_GINT64_MODIFIER "x, 0x%" G_GINT64_MODIFIER "x, ...)\n",
+           functionNames[call->function], call->args[0], call->args[1]);
+  }
+}
+
+/*
+ * Replay re-issues the state, uniform, buffer data and draw calls. Object
+ * creation and deletion, shader building, queries and readbacks are skipped,
+ * so the stream must be replayed where the objects it names exist, e.g. in
+ * the context it was recorded in.
+ */
+void rsgGlRecordingReplay(const RsgGlRecording* rec) {
+  const RsgGl* gl = rsgGl;
+  guint i;
+  assert(rec->keepCalls);
+
+  for (i = 0; i < rec->calls->len; i++) {
+    const RsgGlCall* call = &g_array_index(rec->calls, RsgGlCall, i);
+    switch (call->function) {
+      case RSG_GL_ActiveTexture:
+        gl->ActiveTexture(ARG(call, 0, GLenum));
+        break;
+      case RSG_GL_BindBuffer:
+        gl->BindBuffer(ARG(call, 0, GLenum), ARG(call, 1, GLuint));
+        break;
+      case RSG_GL_BindFramebuffer:
+        gl->BindFramebuffer(ARG(call, 0, GLenum), ARG(call, 1, GLuint));
+        break;
+      case RSG_GL_BindTexture:
+        gl->BindTexture(ARG(call, 0, GLenum), ARG(call, 1, GLuint));
+        break;
+      case RSG_GL_BindVertexArray:
+        gl->BindVertexArray(ARG(call, 0, GLuint));
+        break;
+      case RSG_GL_BlendFunc:
+        gl->BlendFunc(ARG(call, 0, GLenum), ARG(call, 1, GLenum));
+        break;
+      case RSG_GL_BufferData:
+        gl->BufferData(ARG(call, 0, GLenum), ARG(call, 1, GLsizeiptr),
+                       ARG(call, 2, void*) == NULL ? NULL
+                                                  : DATA(rec, call, 2),
+                       ARG(call, 3, GLenum));
+        break;
+      case RSG_GL_BufferSubData:
+        gl->BufferSubData(ARG(call, 0, GLenum), ARG(call, 1, GLintptr),
+                          ARG(call, 2, GLsizeiptr), DATA(rec, call, 3));
+        break;
+      case RSG_GL_Clear:
+        gl->Clear(ARG(call, 0, GLbitfield));
+        break;
+      case RSG_GL_ClearColor:
+        gl->ClearColor(ARG(call, 0, GLfloat), ARG(call, 1, GLfloat),
+                       ARG(call, 2, GLfloat), ARG(call, 3, GLfloat));
+        break;
+      case RSG_GL_CopyBufferSubData:
+        gl->CopyBufferSubData(ARG(call, 0, GLenum), ARG(call, 1, GLenum),
+                              ARG(call, 2, GLintptr), ARG(call, 3, GLintptr),
+                              ARG(call, 4, GLsizeiptr));
+        break;
+      case RSG_GL_DepthFunc:
+        gl->DepthFunc(ARG(call, 0, GLenum));
+        break;
+      case RSG_GL_Disable:
+        gl->Disable(ARG(call, 0, GLenum));
+        break;
+      case RSG_GL_DisableVertexAttribArray:
+        gl->DisableVertexAttribArray(ARG(call, 0, GLuint));
+        break;
+      case RSG_GL_DrawElements:
+        gl->DrawElements(ARG(call, 0, GLenum), ARG(call, 1, GLsizei),
+                         ARG(call, 2, GLenum), ARG(call, 3, void*));
+        break;
+      case RSG_GL_DrawElementsBaseVertex:
+        gl->DrawElementsBaseVertex(ARG(call, 0, GLenum), ARG(call, 1, GLsizei),
+                                   ARG(call, 2, GLenum), ARG(call, 3, void*),
+                                   ARG(call, 4, GLint));
+        break;
+      case RSG_GL_DrawElementsInstanced:
+        gl->DrawElementsInstanced(ARG(call, 0, GLenum), ARG(call, 1, GLsizei),
+                                  ARG(call, 2, GLenum), ARG(call, 3, void*),
+                                  ARG(call, 4, GLsizei));
+        break;
+      case RSG_GL_DrawElementsInstancedBaseVertex:
+        gl->DrawElementsInstancedBaseVertex(
+            ARG(call, 0, GLenum), ARG(call, 1, GLsizei), ARG(call, 2, GLenum),
+            ARG(call, 3, void*), ARG(call, 4, GLsizei), ARG(call, 5, GLint));
+        break;
+      case RSG_GL_Enable:
+        gl->Enable(ARG(call, 0, GLenum));
+        break;
+      case RSG_GL_EnableVertexAttribArray:
+        gl->EnableVertexAttribArray(ARG(call, 0, GLuint));
+        break;
+      case RSG_GL_UniformMatrix4fv:
+        gl->UniformMatrix4fv(ARG(call, 0, GLint), ARG(call, 1, GLsizei),
+                             ARG(call, 2, GLboolean),
+                             (const GLfloat*)DATA(rec, call, 3));
+        break;
+      case RSG_GL_UseProgram:
+        gl->UseProgram(ARG(call, 0, GLuint));
+        break;
+      case RSG_GL_VertexAttrib4fv:
+        gl->VertexAttrib4fv(ARG(call, 0, GLuint),
+                            (const GLfloat*)DATA(rec, call, 1));
+        break;
+      case RSG_GL_VertexAttribDivisor:
+        gl->VertexAttribDivisor(ARG(call, 0, GLuint), ARG(call, 1, GLuint));
+        break;
+      case RSG_GL_VertexAttribPointer:
+        // the pointer is an offset into the bound buffer
+        gl->VertexAttribPointer(ARG(call, 0, GLuint), ARG(call, 1, GLint),
+                                ARG(call, 2, GLenum), ARG(call, 3, GLboolean),
+                                ARG(call, 4, GLsizei), ARG(call, 5, void*));
+        break;
+      case RSG_GL_Viewport:
+        gl->Viewport(ARG(call, 0, GLint), ARG(call, 1, GLint),
+                     ARG(call, 2, GLsizei), ARG(call, 3, GLsizei));
+        break;
+      default:
+        break;
+    }
+  }
+}
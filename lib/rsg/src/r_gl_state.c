@@ -0,0 +1,186 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "rsg_internal.h"
+
+/*
+ * GL state tracker.
+ * Shadows the GL state touched by RSG and skips calls that would not change
+ * it. The shadow is invalidated at the start of every frame and after
+ * foreign code (e.g. user callbacks) had a chance to touch GL.
+ */
+
+#define UNKNOWN_NAME ((GLuint)-1)
+#define UNKNOWN_ENUM ((GLenum)-1)
+
+RsgGlState* rsgGlStateCreate(void) {
+  RsgGlState* state = rsgMalloc(sizeof(*state));
+  rsgGlStateInvalidate(state);
+  return state;
+}
+
+void rsgGlStateInvalidate(RsgGlState* state) {
+  size_t i;
+  state->program = UNKNOWN_NAME;
+  state->vertexArray = UNKNOWN_NAME;
+  state->arrayBuffer = UNKNOWN_NAME;
+  state->elementArrayBuffer = UNKNOWN_NAME;
+  state->activeTexture = UNKNOWN_ENUM;
+  for (i = 0; i < RSG_GL_MAX_TEXTURE_UNITS; i++)
+    state->textures[i] = UNKNOWN_NAME;
+  state->blend = -1;
+  state->blendSrc = UNKNOWN_ENUM;
+  state->blendDst = UNKNOWN_ENUM;
+  state->depthTest = -1;
+  state->depthFunc = UNKNOWN_ENUM;
+  state->clearColorValid = false;
+}
+
+void rsgGlStateBeginFrame(RsgGlState* state) {
+  state->lastFrameDraws = state->frameDraws;
+  state->lastFrameInstances = state->frameInstances;
+  state->frameDraws = 0;
+  state->frameInstances = 0;
+  state->lastFrameCalls = state->frameCalls;
+  state->lastFrameElided = state->frameElided;
+  state->totalCalls += state->frameCalls;
+  state->totalElided += state->frameElided;
+  state->frameCalls = 0;
+  state->frameElided = 0;
+  rsgGlStateInvalidate(state);
+}
+
+/*
+ * Returns true if the call must be issued, and updates counters.
+ */
+static bool changes(RsgGlState* state, bool differs) {
+  if (differs) {
+    state->frameCalls++;
+    return true;
+  }
+  state->frameElided++;
+  return false;
+}
+
+void rsgGlUseProgram(RsgGlState* state, GLuint program) {
+  if (changes(state, state->program != program)) {
+    rsgGl->UseProgram(program);
+    state->program = program;
+  }
+}
+
+void rsgGlBindVertexArray(RsgGlState* state, GLuint vertexArray) {
+  if (changes(state, state->vertexArray != vertexArray)) {
+    rsgGl->BindVertexArray(vertexArray);
+    state->vertexArray = vertexArray;
+    // element array buffer binding is part of the VAO state
+    state->elementArrayBuffer = UNKNOWN_NAME;
+  }
+}
+
+void rsgGlBindBuffer(RsgGlState* state, GLenum target, GLuint buffer) {
+  GLuint* binding = NULL;
+  if (target == GL_ARRAY_BUFFER) binding = &state->arrayBuffer;
+  if (target == GL_ELEMENT_ARRAY_BUFFER) binding = &state->elementArrayBuffer;
+
+  if (binding == NULL) {
+    // untracked target
+    state->frameCalls++;
+    rsgGl->BindBuffer(target, buffer);
+    return;
+  }
+  if (changes(state, *binding != buffer)) {
+    rsgGl->BindBuffer(target, buffer);
+    *binding = buffer;
+  }
+}
+
+void rsgGlActiveTexture(RsgGlState* state, GLenum texture) {
+  assert(texture - GL_TEXTURE0 < RSG_GL_MAX_TEXTURE_UNITS);
+  if (changes(state, state->activeTexture != texture)) {
+    rsgGl->ActiveTexture(texture);
+    state->activeTexture = texture;
+  }
+}
+
+void rsgGlBindTexture(RsgGlState* state, GLenum target, GLuint texture) {
+  if (target != GL_TEXTURE_2D || state->activeTexture == UNKNOWN_ENUM) {
+    // untracked target or unit
+    state->frameCalls++;
+    rsgGl->BindTexture(target, texture);
+    return;
+  }
+  GLuint* binding = &state->textures[state->activeTexture - GL_TEXTURE0];
+  if (changes(state, *binding != texture)) {
+    rsgGl->BindTexture(target, texture);
+    *binding = texture;
+  }
+}
+
+static void setCapability(RsgGlState* state, GLenum cap, int enabled) {
+  int* shadow = NULL;
+  if (cap == GL_BLEND) shadow = &state->blend;
+  if (cap == GL_DEPTH_TEST) shadow = &state->depthTest;
+
+  if (shadow != NULL && changes(state, *shadow != enabled) == false) return;
+  if (shadow == NULL) state->frameCalls++;
+
+  if (enabled)
+    rsgGl->Enable(cap);
+  else
+    rsgGl->Disable(cap);
+  if (shadow != NULL) *shadow = enabled;
+}
+
+void rsgGlEnable(RsgGlState* state, GLenum cap) {
+  setCapability(state, cap, 1);
+}
+
+void rsgGlDisable(RsgGlState* state, GLenum cap) {
+  setCapability(state, cap, 0);
+}
+
+void rsgGlBlendFunc(RsgGlState* state, GLenum sfactor, GLenum dfactor) {
+  if (changes(state,
+              state->blendSrc != sfactor || state->blendDst != dfactor)) {
+    rsgGl->BlendFunc(sfactor, dfactor);
+    state->blendSrc = sfactor;
+    state->blendDst = dfactor;
+  }
+}
+
+void rsgGlDepthFunc(RsgGlState* state, GLenum func) {
+  if (changes(state, state->depthFunc != func)) {
+    rsgGl->DepthFunc(func);
+    state->depthFunc = func;
+  }
+}
+
+void rsgGlClearColor(RsgGlState* state, vec4s color) {
+  if (changes(state, state->clearColorValid == false ||
+                         memcmp(&state->clearColor, &color, sizeof(color)))) {
+    rsgGl->ClearColor(color.raw[0], color.raw[1], color.raw[2], color.raw[3]);
+    state->clearColor = color;
+    state->clearColorValid = true;
+  }
+}
@@ -20,56 +20,213 @@
  * IN THE SOFTWARE.
  */
 #include <stdio.h>
+#include <string.h>
 
 #include "rsg_internal.h"
 
+/*
+ * Group node.
+ * Processes its children from left to right, saving and restoring the local
+ * context around them.
+ *
+ * Children are kept in a packed array together with their (class-constant)
+ * processFunc, so traversal needs neither list walking nor per-child type
+ * checks. The group owns the render list compiled from its children; any
+ * edit of the children invalidates it.
+ *
+ * The group merges the bounds of its children into a box that is cached
+ * until something in the subtree changes. If the box is outside of the view
+ * frustum, the whole subtree is skipped. Groups with a child of unknown
+ * bounds (e.g. a callback or a camera) are never culled.
+ *
+ * In the update phase, the group refreshes its bounds and walks its children
+ * like process does, handing child groups to the worker pool if it can.
+ *
+ * Properties: none
+ */
+
 G_DECLARE_FINAL_TYPE(RsgGroupNode, rsg_group_node, RSG, GROUP_NODE,
                      RsgAbstractNode)
 
+typedef struct {
+  RsgAbstractNode* node;
+  void (*processFunc)(RsgAbstractNode* node, RsgContext* ctx);
+} RsgGroupChild;
+
 struct _RsgGroupNode {
   RsgAbstractNode abstract;
-  GList* children;
-  RsgLocalContext* lctxBackup;
+  RsgGroupChild* children;
+  size_t numChildren;
+  size_t capacity;
+  RsgRenderList* renderList;
+
+  // bounds cache
+  vec3s bounds[2];
+  bool boundsKnown;
+  guint boundsGeneration;
 };
 
 G_DEFINE_TYPE(RsgGroupNode, rsg_group_node, RSG_TYPE_ABSTRACT_NODE)
 
+static void updateBounds(RsgGroupNode* cnode) {
+  if (rsgAbstractNodeChangedSince(RSG_ABSTRACT_NODE(cnode),
+                                  cnode->boundsGeneration) == false)
+    return;
+
+  /*
+   * Walk the children in order, as transforms affect their right siblings
+   */
+  mat4s model = glms_mat4_identity();
+  glms_aabb_invalidate(cnode->bounds);
+  cnode->boundsKnown = true;
+  size_t i;
+  for (i = 0; i < cnode->numChildren; i++) {
+    RsgAbstractNode* childNode = cnode->children[i].node;
+    bool (*boundsFunc)(RsgAbstractNode*, mat4s*, vec3s*) =
+        RSG_ABSTRACT_NODE_GET_CLASS(childNode)->boundsFunc;
+    if (boundsFunc == NULL) continue;
+    // carry on after unknown bounds, to bring all nested caches up to date
+    if (boundsFunc(childNode, &model, cnode->bounds) == false)
+      cnode->boundsKnown = false;
+  }
+  cnode->boundsGeneration = rsgAbstractNodeGetGeneration();
+}
+
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  updateBounds(cnode);
+  if (cnode->boundsKnown == false) return false;
+  if (glms_aabb_isvalid(cnode->bounds))
+    rsgBoundsMergeTransformed(box, cnode->bounds, model);
+  return true;
+}
+
+bool rsgGroupNodeCull(RsgAbstractNode* node, RsgContext* ctx) {
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  updateBounds(cnode);
+  if (cnode->boundsKnown == false || glms_aabb_isvalid(cnode->bounds) == false)
+    return false;
+  return rsgBoundsCull(ctx, cnode->bounds, &ctx->local->u_model);
+}
+
 static void process(RsgAbstractNode* node, RsgContext* ctx) {
   RsgGroupNode* cnode = RSG_GROUP_NODE(node);
-  if (cnode->children == NULL) {
+  if (cnode->numChildren == 0) {
     // no children
     return;
   }
+  if (rsgGroupNodeCull(node, ctx)) return;
   /*
    * Save the local context copy, process all children from left to right, and
    * restore the local context.
    */
-  *cnode->lctxBackup = *ctx->local;
+  RsgLocalContext* lctxBackup =
+      rsgArenaAlloc(ctx->frameArena, sizeof(*lctxBackup));
+  *lctxBackup = *ctx->local;
+
+  const RsgGroupChild* child = cnode->children;
+  const RsgGroupChild* end = cnode->children + cnode->numChildren;
+  for (; child != end; child++) child->processFunc(child->node, ctx);
+
+  *ctx->local = *lctxBackup;
+}
+
+static void update(RsgAbstractNode* node, RsgContext* ctx) {
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  // the bounds of all nested groups get computed along, so on the root this
+  // leaves workers with nothing but read-only bounds queries
+  updateBounds(cnode);
 
-  GList* elem = NULL;
-  for (elem = cnode->children; elem != NULL; elem = elem->next) {
-    RsgAbstractNode* childNode = RSG_ABSTRACT_NODE(elem->data);
-    RSG_ABSTRACT_NODE_GET_CLASS(childNode)->processFunc(childNode, ctx);
+  RsgLocalContext lctxBackup = *ctx->local;
+  size_t i;
+  for (i = 0; i < cnode->numChildren; i++) {
+    RsgAbstractNode* childNode = cnode->children[i].node;
+    void (*updateFunc)(RsgAbstractNode*, RsgContext*) =
+        RSG_ABSTRACT_NODE_GET_CLASS(childNode)->updateFunc;
+    if (updateFunc == NULL) continue;
+    // the replay takes it from here
+    if (rsgAbstractNodeIsShared(childNode)) break;
+
+    if (RSG_IS_GROUP_NODE(childNode) && rsgUpdateSpawn(childNode, ctx->local))
+      continue;
+    updateFunc(childNode, ctx);
   }
+  *ctx->local = lctxBackup;
+}
 
-  *ctx->local = *cnode->lctxBackup;
+static void compileChildren(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  size_t i;
+  for (i = 0; i < cnode->numChildren; i++) {
+    RsgAbstractNode* childNode = cnode->children[i].node;
+    RSG_ABSTRACT_NODE_GET_CLASS(childNode)->compileFunc(childNode, list);
+  }
+}
+
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_CALL,
+                                  .node = node,
+                                  .list = cnode->renderList});
 }
 
 static void finalize(GObject* node) {
   RsgGroupNode* cnode = RSG_GROUP_NODE(node);
-  g_list_free(cnode->children);  // NOTE: free only list elems, not the child
-                                 // nodes themselves
-  rsgFree(cnode->lctxBackup);
+  size_t i;
+  for (i = 0; i < cnode->numChildren; i++)
+    rsgAbstractNodeRemoveParent(cnode->children[i].node,
+                                RSG_ABSTRACT_NODE(node));
+  rsgFree(cnode->children);  // NOTE: free only the array, not the child
+                             // nodes themselves
+  rsgRenderListDestroy(cnode->renderList);
+
+  G_OBJECT_CLASS(rsg_group_node_parent_class)->finalize(node);
+}
+
+/*
+ * Structural edits: the list needs recompiling and the scene a redraw
+ */
+static void changed(RsgGroupNode* cnode) {
+  rsgRenderListInvalidate(cnode->renderList);
+  rsgAbstractNodeMarkDirty(RSG_ABSTRACT_NODE(cnode));
 }
 
 static void rsg_group_node_class_init(RsgGroupNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
+  RSG_ABSTRACT_NODE_CLASS(klass)->updateFunc = update;
   G_OBJECT_CLASS(klass)->finalize = finalize;
 }
 
 static void rsg_group_node_init(RsgGroupNode* cnode) {
   cnode->children = NULL;
-  cnode->lctxBackup = rsgMalloc(sizeof(*cnode->lctxBackup));
+  cnode->numChildren = 0;
+  cnode->capacity = 0;
+  cnode->boundsKnown = false;
+  cnode->boundsGeneration = 0;  // stale
+  cnode->renderList = rsgRenderListCreate(RSG_ABSTRACT_NODE(cnode),
+                                          compileChildren, true);
+}
+
+static void reserve(RsgGroupNode* cnode, size_t numChildren) {
+  if (numChildren <= cnode->capacity) return;
+
+  size_t capacity = cnode->capacity == 0 ? 4 : cnode->capacity;
+  while (capacity < numChildren) capacity *= 2;
+
+  cnode->children =
+      rsgRealloc(cnode->children, capacity * sizeof(*cnode->children));
+  cnode->capacity = capacity;
+}
+
+static RsgGroupChild makeChild(RsgGroupNode* cnode, RsgNode* childNode) {
+  assert(RSG_IS_ABSTRACT_NODE(childNode) != false);
+  RsgAbstractNode* abstractChild = RSG_ABSTRACT_NODE(childNode);
+  rsgAbstractNodeAddParent(abstractChild, RSG_ABSTRACT_NODE(cnode));
+  return (RsgGroupChild){
+      .node = abstractChild,
+      .processFunc = RSG_ABSTRACT_NODE_GET_CLASS(abstractChild)->processFunc};
 }
 
 RsgNode* rsgGroupNodeCreate(void) {
@@ -78,9 +235,88 @@ RsgNode* rsgGroupNodeCreate(void) {
 
 void rsgGroupNodeAddChild(RsgNode* node, RsgNode* childNode) {
   assert(RSG_IS_GROUP_NODE(node) != false);
-  assert(RSG_IS_ABSTRACT_NODE(childNode) != false);
 
   RsgGroupNode* cnode = RSG_GROUP_NODE(node);
 
-  cnode->children = g_list_append(cnode->children, childNode);
+  reserve(cnode, cnode->numChildren + 1);
+  cnode->children[cnode->numChildren++] = makeChild(cnode, childNode);
+  changed(cnode);
+}
+
+void rsgGroupNodeInsertChildren(RsgNode* node,
+                                size_t index,
+                                RsgNode** childNodes,
+                                size_t numChildNodes) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  assert(index <= cnode->numChildren);
+  size_t i;
+
+  reserve(cnode, cnode->numChildren + numChildNodes);
+  memmove(&cnode->children[index + numChildNodes], &cnode->children[index],
+          (cnode->numChildren - index) * sizeof(*cnode->children));
+  for (i = 0; i < numChildNodes; i++)
+    cnode->children[index + i] = makeChild(cnode, childNodes[i]);
+  cnode->numChildren += numChildNodes;
+  changed(cnode);
+}
+
+void rsgGroupNodeRemoveChildren(RsgNode* node,
+                                size_t index,
+                                size_t numChildNodes) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  assert(index + numChildNodes <= cnode->numChildren);
+  size_t i;
+
+  for (i = index; i < index + numChildNodes; i++)
+    rsgAbstractNodeRemoveParent(cnode->children[i].node,
+                                RSG_ABSTRACT_NODE(node));
+  memmove(&cnode->children[index], &cnode->children[index + numChildNodes],
+          (cnode->numChildren - index - numChildNodes) *
+              sizeof(*cnode->children));
+  cnode->numChildren -= numChildNodes;
+  changed(cnode);
+}
+
+void rsgGroupNodeRemoveChild(RsgNode* node, RsgNode* childNode) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  size_t i;
+
+  for (i = 0; i < cnode->numChildren; i++) {
+    if (cnode->children[i].node == (RsgAbstractNode*)childNode) {
+      rsgGroupNodeRemoveChildren(node, i, 1);
+      return;
+    }
+  }
+}
+
+void rsgGroupNodeMoveChild(RsgNode* node, size_t fromIndex, size_t toIndex) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  assert(fromIndex < cnode->numChildren);
+  assert(toIndex < cnode->numChildren);
+
+  RsgGroupChild child = cnode->children[fromIndex];
+  if (fromIndex < toIndex)
+    memmove(&cnode->children[fromIndex], &cnode->children[fromIndex + 1],
+            (toIndex - fromIndex) * sizeof(*cnode->children));
+  else
+    memmove(&cnode->children[toIndex + 1], &cnode->children[toIndex],
+            (fromIndex - toIndex) * sizeof(*cnode->children));
+  cnode->children[toIndex] = child;
+  changed(cnode);
+}
+
+size_t rsgGroupNodeGetNumChildren(RsgNode* node) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  return RSG_GROUP_NODE(node)->numChildren;
+}
+
+RsgNode* rsgGroupNodeGetChild(RsgNode* node, size_t index) {
+  assert(RSG_IS_GROUP_NODE(node) != false);
+  RsgGroupNode* cnode = RSG_GROUP_NODE(node);
+  assert(index < cnode->numChildren);
+  return (RsgNode*)cnode->children[index].node;
 }
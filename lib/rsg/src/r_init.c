@@ -22,15 +22,23 @@
 
 #include "rsg_internal.h"
 
-void rsgInit(int width, int height, int flags) {
-  assert(rsgGetGlobalContext() == NULL);
+#define RSG_FRAME_ARENA_DEFAULT_SIZE (64 * 1024)
+
+static void windowDamaged(GLFWwindow* window) {
+  rsgGetGlobalContext()->forceRedraw = true;
+}
+
+static void framebufferResized(GLFWwindow* window, int width, int height) {
+  rsgGetGlobalContext()->forceRedraw = true;
+}
+
+static GLFWwindow* createWindow(int width, int height, int flags) {
   glfwInit();
 
   GLFWmonitor* monitor = glfwGetPrimaryMonitor();
   const GLFWvidmode* mode = glfwGetVideoMode(monitor);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-  glfwSwapInterval(1);  // TODO: what about the events?
   GLFWwindow* window = NULL;
   if ((flags & RSG_INIT_FLAG_FULLSCREEN) != 0) {
     window =
@@ -39,6 +47,7 @@ void rsgInit(int width, int height, int flags) {
     window = glfwCreateWindow(width, height, "RSG/GLFW", NULL, NULL);
   }
   glfwMakeContextCurrent(window);
+  glfwSwapInterval(1);  // needs a current context; see rsgSetSwapInterval()
   int realWidth, realHeight;
   glfwGetWindowSize(window, &realWidth, &realHeight);
   //  glfwSetCursorPos(window, (double)realWidth / 2.0, (double)realHeight
@@ -49,17 +58,46 @@ void rsgInit(int width, int height, int flags) {
 
   glewExperimental = GL_TRUE;
   glewInit();
+  rsgGlDispatchInit(glfwGetProcAddress);
 
   printf("RSG: screen %dx%d, GLFW %s, GLEW %s\nRSG: OpenGL context %s\n",
          realWidth, realHeight, glfwGetVersionString(),
          glewGetString(GLEW_VERSION), glGetString(GL_VERSION));
 
+  glfwSetWindowRefreshCallback(window, windowDamaged);
+  glfwSetFramebufferSizeCallback(window, framebufferResized);
+  return window;
+}
+
+void rsgInit(int width, int height, int flags) {
+  assert(rsgGetGlobalContext() == NULL);
+  GLFWwindow* window = NULL;
+  RsgOffscreen* offscreen = NULL;
+  if ((flags & RSG_INIT_FLAG_NODISPLAY) != 0) {
+    printf("RSG: no display, GL calls go to the null backend\n");
+    rsgGlDispatchInit(NULL);
+  } else if ((flags & RSG_INIT_FLAG_OFFSCREEN) != 0) {
+    offscreen = rsgOffscreenCreate(width, height);
+  } else {
+    window = createWindow(width, height, flags);
+  }
+
   /*
    * Create and configure the global context
    */
   RsgGlobalContext* gctx = rsgMalloc(sizeof(*gctx));
   gctx->window = window;
+  gctx->offscreen = offscreen;
   gctx->totalTraversals = 0L;
+  gctx->skippedTraversals = 0L;
+  gctx->quit = false;
+  gctx->forceRedraw = true;
+  gctx->pipelined = (flags & RSG_INIT_FLAG_PIPELINED) != 0;
+  gctx->frameArena = rsgArenaCreate(RSG_FRAME_ARENA_DEFAULT_SIZE);
+  gctx->glState = rsgGlStateCreate();
+  gctx->cull = (RsgCullStat){0, 0, 0};
+  gctx->lastFrameCull = gctx->cull;
+  gctx->scheduler = (RsgScheduler){0, 0, 0, 0};
 
   rsgSetGlobalContext(gctx);
 }
@@ -20,54 +20,222 @@
  * IN THE SOFTWARE.
  */
 #include <stdio.h>
-#include <unistd.h>
 
 #include "rsg_internal.h"
 
+static void compileRoot(RsgAbstractNode* root, RsgRenderList* list) {
+  RSG_ABSTRACT_NODE_GET_CLASS(root)->compileFunc(root, list);
+}
+
+static void setupContext(RsgContext* ctx) {
+  // the local context lives in the frame arena
+  ctx->global = rsgGetGlobalContext();
+  ctx->frameArena = ctx->global->frameArena;
+  ctx->local = NULL;
+  ctx->gl = ctx->global->glState;
+}
+
+/*
+ * Bring the scene up to date before a frame. This is the frame's only
+ * delivery point: changed values are propagated through the bindings, then
+ * the property changes coalesced since the last frame are delivered, each
+ * (node, property) pair once; handlers may set off more bindings. Changes
+ * made during a traversal wait here for the next frame.
+ */
+static void prepareFrame(RsgContext* ctx) {
+  // property updates posted by other threads
+  rsgUpdateQueueApply();
+
+  // sample input devices; this raises dirty flags if anything changed
+  rsgAbstractNodePollAll(ctx);
+
+  do {
+    rsgBindingEvaluatePending();
+    rsgAbstractNodeFlushNotify();
+  } while (rsgBindingIsPending());
+}
+
+static bool changesPending(RsgAbstractNode* root) {
+  return rsgAbstractNodeIsDirty(root) || rsgBindingIsPending() ||
+         rsgAbstractNodeIsNotifyPending();
+}
+
+/*
+ * Traverse the scene once; the GL state frame, the clear and the swap are up
+ * to the caller
+ */
+static void traverse(RsgContext* ctx,
+                     RsgAbstractNode* root,
+                     RsgRenderList* rootList) {
+  // start a new generation before anything runs, so nodes marked dirty
+  // during the frame (callbacks, handlers, updates posted meanwhile) stay
+  // dirty for the next one
+  rsgAbstractNodeCleanAll();
+
+  // CPU side of the frame, on the worker pool
+  rsgUpdateRun(root);
+
+  // drop the previous frame's scratch data and start with a default local
+  // context before each traversal
+  ctx->frameArena = ctx->global->frameArena;
+  rsgArenaReset(ctx->frameArena);
+  ctx->local = rsgArenaAlloc(ctx->frameArena, sizeof(*ctx->local));
+  rsgLocalContextReset(ctx->local);
+
+  // the root node isn't anyone's child, so pick up its own changes by
+  // recompiling its (tiny) list every frame; nested lists are reused
+  rsgRenderListInvalidate(rootList);
+  if (rsgProfilerBeginFrame()) {
+    rsgRenderListReplayProfiled(rootList, ctx);
+    rsgProfilerEndFrame();
+  } else {
+    rsgRenderListReplay(rootList, ctx);
+  }
+  ctx->global->totalTraversals++;
+}
+
+void rsgTraverse(RsgNode* root) {
+  assert(rsgGetGlobalContext() != NULL);
+  assert(root != NULL);
+  RsgAbstractNode* abstractRoot = RSG_ABSTRACT_NODE(root);
+  RsgRenderList* rootList =
+      rsgRenderListCreate(abstractRoot, compileRoot, false);
+  RsgContext context;
+  setupContext(&context);
+
+  prepareFrame(&context);
+  rsgGlStateBeginFrame(context.gl);
+  traverse(&context, abstractRoot, rootList);
+  rsgRenderListDestroy(rootList);
+}
+
+static void noEvents(void) {}
+
+static bool running(const RsgGlobalContext* gctx) {
+  if (gctx->quit) return false;
+  return gctx->window == NULL || glfwWindowShouldClose(gctx->window) == 0;
+}
+
+static void present(RsgContext* ctx) {
+  // queue the readback before the back buffer goes away
+  rsgCaptureFrame();
+  // offscreen, the frame just stays in the framebuffer
+  if (ctx->global->window != NULL) glfwSwapBuffers(ctx->global->window);
+}
+
+void rsgMainLoopQuit(void) {
+  RsgGlobalContext* gctx = rsgGetGlobalContext();
+  assert(gctx != NULL);
+  gctx->quit = true;
+  // wake up a retained mode loop waiting for events
+  if (gctx->window != NULL) glfwPostEmptyEvent();
+}
+
 void rsgMainLoop(RsgNode* root, int traversalFreq) {
   assert(rsgGetGlobalContext() != NULL);
+  assert(rsgGetGlobalContext()->window != NULL ||
+         rsgGetGlobalContext()->offscreen != NULL);
   assert(root != NULL);
   void (*checkEventsFunc)(void) = NULL;
-  int (*usecSleepFunc)(useconds_t usec) = NULL;
-  useconds_t usecSleepPeriod = 0;
+  bool skipCleanFrames = false;
+  RsgScheduler* scheduler = NULL;
   RsgAbstractNode* abstractRoot = RSG_ABSTRACT_NODE(root);
-  /*
-   * Set up the context
-   */
-  RsgContext* ctx = rsgMalloc(sizeof(*ctx));
-  ctx->global = rsgGetGlobalContext();
-  ctx->local = rsgMalloc(sizeof(*ctx->local));
+  RsgRenderList* rootList =
+      rsgRenderListCreate(abstractRoot, compileRoot, false);
+  RsgContext context;
+  RsgContext* ctx = &context;
+  setupContext(ctx);
+
+  RsgPipeline* pipeline = NULL;
+  if (ctx->global->pipelined) {
+    printf("RSG: pipelined frames (one frame of latency)\n");
+    pipeline = rsgPipelineCreate(abstractRoot, rootList);
+  }
 
-  if (traversalFreq <= 0) {
+  if (traversalFreq <= 0 && ctx->global->window == NULL) {
+    // offscreen there are no events to wait for: draw as fast as possible
+    printf("RSG: main loop offscreen, unthrottled\n");
+    checkEventsFunc = noEvents;
+  } else if (traversalFreq <= 0) {
     // event-driven retained mode
     printf("RSG: main loop in retained mode\n");
     checkEventsFunc = glfwWaitEvents;
-    usecSleepFunc = NULL;
+    skipCleanFrames = true;
   } else {
     // continunous update mode
     printf("RSG: main loop in immediate mode (%d traversals per sec)\n",
            traversalFreq);
-    checkEventsFunc = glfwPollEvents;
-    usecSleepFunc = usleep;
-    usecSleepPeriod = (int)((1.0f / traversalFreq) * 1000000);
+    checkEventsFunc = ctx->global->window != NULL ? glfwPollEvents : noEvents;
+    scheduler = &ctx->global->scheduler;
+    rsgSchedulerStart(scheduler, traversalFreq);
   }
 
-  while (glfwWindowShouldClose(ctx->global->window) == 0) {
+  while (running(ctx->global)) {
     checkEventsFunc();
+    prepareFrame(ctx);
 
-    // re-set the local context with default values before each traversal
-    rsgLocalContextReset(ctx->local);
-
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    RSG_ABSTRACT_NODE_GET_CLASS(abstractRoot)->processFunc(abstractRoot, ctx);
-    ctx->global->totalTraversals++;
+    bool clean = skipCleanFrames && ctx->global->forceRedraw == false &&
+                 rsgAbstractNodeIsDirty(abstractRoot) == false;
+    if (clean && (pipeline == NULL || rsgPipelineIsReady(pipeline) == false)) {
+      // nothing changed since the last traversal: no redraw, no swap
+      ctx->global->skippedTraversals++;
+      continue;
+    }
+    if (clean == false) {
+      ctx->global->forceRedraw = false;
+      ctx->global->lastFrameCull = ctx->global->cull;
+      ctx->global->cull = (RsgCullStat){0, 0, 0};
+    }
 
-    glfwSwapBuffers(ctx->global->window);
-    if (usecSleepFunc != NULL) usleep(usecSleepPeriod);
+    if (pipeline != NULL) {
+      // build the next frame on the worker while submitting the last one
+      if (clean == false) {
+        // as in traverse(), the build sees a fresh generation
+        rsgAbstractNodeCleanAll();
+        rsgPipelineBuildAsync(pipeline);
+      }
+      if (rsgPipelineIsReady(pipeline)) {
+        rsgGlStateBeginFrame(ctx->gl);
+        rsgGlClearColor(ctx->gl, (vec4s){0.0f, 0.0f, 0.0f, 1.0f});
+        rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        rsgPipelineSubmit(pipeline, ctx);
+        present(ctx);
+      }
+      if (rsgPipelineWait(pipeline)) {
+        ctx->global->totalTraversals++;
+        // the new frame still needs submitting: don't wait for events
+        if (skipCleanFrames) glfwPostEmptyEvent();
+      }
+    } else {
+      rsgGlStateBeginFrame(ctx->gl);
+      rsgGlClearColor(ctx->gl, (vec4s){0.0f, 0.0f, 0.0f, 1.0f});
+      rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      traverse(ctx, abstractRoot, rootList);
+      present(ctx);
+    }
+    // changes made during the frame (callbacks, handlers) are delivered and
+    // drawn by the next one; don't wait for events
+    if (skipCleanFrames && changesPending(abstractRoot)) glfwPostEmptyEvent();
+    if (scheduler != NULL) rsgSchedulerWait(scheduler);
   }
 
-  printf("RSG: main loop done after %zu traversals\n",
-         ctx->global->totalTraversals);
+  ctx->global->quit = false;
+  if (pipeline != NULL) rsgPipelineDestroy(pipeline);
+  rsgRenderListDestroy(rootList);
+  rsgArenaReset(ctx->global->frameArena);
+  printf("RSG: main loop done after %zu traversals (%zu skipped as clean)\n",
+         ctx->global->totalTraversals, ctx->global->skippedTraversals);
+  if (scheduler != NULL)
+    printf("RSG: %zu of %zu frame deadlines missed\n", scheduler->missed,
+           scheduler->frames);
+  printf("RSG: frame arena high-water mark %zu bytes\n",
+         ctx->global->frameArena->highWater);
+  rsgGlStateBeginFrame(ctx->gl);  // fold the last frame into the totals
+  printf("RSG: GL state calls issued %zu, elided %zu\n",
+         ctx->gl->totalCalls, ctx->gl->totalElided);
+  printf("RSG: last frame issued %zu draw calls for %zu instances\n",
+         ctx->gl->lastFrameDraws, ctx->gl->lastFrameInstances);
+  printf("RSG: last frame tested %zu bounds, culled %zu, drew %zu meshes\n",
+         ctx->global->cull.tested, ctx->global->cull.culled,
+         ctx->global->cull.drawn);
 }
@@ -20,63 +20,286 @@
  * IN THE SOFTWARE.
  */
 
+#include <glib.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
 
-static bool debug = false;
+/*
+ * Tracked allocator.
+ *
+ * Every chunk carries an inline header right before the memory handed out to
+ * the caller, so free and realloc find their bookkeeping in O(1). Chunks are
+ * registered in per-thread heaps (each with its own lock, which is only ever
+ * contended by cross-thread frees). Small freed chunks are kept in per-heap
+ * size class caches and reused by the next allocation of that class.
+ */
+
+#define CHUNK_MAGIC 0x52534721u /* "RSG!" */
+#define CHUNK_MAGIC_FREED 0x66726565u
+#define SIZE_CLASS_MIN_SHIFT 4 /* 16 bytes */
+#define NUM_SIZE_CLASSES 8     /* 16 .. 2048 bytes */
+#define CACHE_MAX_CHUNKS 64    /* per size class, per heap */
+
+struct memheap;
 
 struct memchunk {
-  void* mem;
-  size_t size;
+  struct memheap* heap;
+  size_t size;      // requested size
+  size_t capacity;  // usable size
+  unsigned int magic;
+  int sizeClass;  // -1 if not cacheable
   LIST_ENTRY(memchunk)
   entries;
 };
 
-LIST_HEAD(listhead, memchunk);
-static struct listhead allocations = LIST_HEAD_INITIALIZER(allocations);
+/*
+ * Keep user memory aligned as malloc() would
+ */
+#define CHUNK_HEADER_SIZE ((sizeof(struct memchunk) + 15) & ~(size_t)15)
+#define CHUNK_TO_MEM(chunk) ((void*)((char*)(chunk) + CHUNK_HEADER_SIZE))
+#define MEM_TO_CHUNK(mem) ((struct memchunk*)((char*)(mem)-CHUNK_HEADER_SIZE))
+
+LIST_HEAD(chunklist, memchunk);
+
+struct memheap {
+  pthread_mutex_t lock;
+  struct chunklist allocations;
+  struct chunklist cache[NUM_SIZE_CLASSES];
+  size_t numCached[NUM_SIZE_CLASSES];
+  size_t numChunks;
+  size_t totalBytes;
+  bool orphaned;  // owner thread has exited
+  LIST_ENTRY(memheap)
+  entries;
+};
+
+LIST_HEAD(heaplist, memheap);
+
+static bool debug = false;
+
+static struct heaplist heaps = LIST_HEAD_INITIALIZER(heaps);
+static pthread_mutex_t heapsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t heapKey;
+static pthread_once_t heapKeyOnce = PTHREAD_ONCE_INIT;
+static __thread struct memheap* localHeap = NULL;
+
+static int sizeClassOf(size_t size) {
+  size_t classSize = (size_t)1 << SIZE_CLASS_MIN_SHIFT;
+  int sizeClass;
+  for (sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; sizeClass++) {
+    if (size <= classSize) return sizeClass;
+    classSize <<= 1;
+  }
+  return -1;
+}
+
+static size_t capacityOf(size_t size, int sizeClass) {
+  if (sizeClass < 0) return size;
+  return (size_t)1 << (sizeClass + SIZE_CLASS_MIN_SHIFT);
+}
+
+static void heapDrainCache(struct memheap* heap) {
+  int sizeClass;
+  for (sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; sizeClass++) {
+    while (!LIST_EMPTY(&heap->cache[sizeClass])) {
+      struct memchunk* chunk = LIST_FIRST(&heap->cache[sizeClass]);
+      LIST_REMOVE(chunk, entries);
+      free(chunk);
+    }
+    heap->numCached[sizeClass] = 0;
+  }
+}
+
+static void heapThreadExit(void* arg) {
+  struct memheap* heap = arg;
+  /*
+   * Live chunks stay registered for leak tracking; the heap itself is handed
+   * over to the next thread that needs one.
+   */
+  pthread_mutex_lock(&heap->lock);
+  heapDrainCache(heap);
+  heap->orphaned = true;
+  pthread_mutex_unlock(&heap->lock);
+}
+
+static void heapKeyCreate(void) {
+  pthread_key_create(&heapKey, heapThreadExit);
+}
+
+static struct memheap* getLocalHeap(void) {
+  if (localHeap != NULL) return localHeap;
+
+  pthread_once(&heapKeyOnce, heapKeyCreate);
+
+  struct memheap* heap;
+  pthread_mutex_lock(&heapsLock);
+  LIST_FOREACH(heap, &heaps, entries) {
+    if (heap->orphaned) break;
+  }
+  if (heap != NULL) {
+    // adopt a heap left behind by an exited thread
+    pthread_mutex_lock(&heap->lock);
+    heap->orphaned = false;
+    pthread_mutex_unlock(&heap->lock);
+  } else {
+    int sizeClass;
+    heap = calloc(1, sizeof(*heap));
+    pthread_mutex_init(&heap->lock, NULL);
+    LIST_INIT(&heap->allocations);
+    for (sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; sizeClass++)
+      LIST_INIT(&heap->cache[sizeClass]);
+    LIST_INSERT_HEAD(&heaps, heap, entries);
+  }
+  pthread_mutex_unlock(&heapsLock);
+
+  pthread_setspecific(heapKey, heap);
+  localHeap = heap;
+  return heap;
+}
+
+/*
+ * Debug mode keeps the live chunks in a set, so that foreign pointers are
+ * told apart without reading in front of them. It is filled from the heaps
+ * when debug mode is switched on.
+ */
+static GHashTable* registry = NULL;
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void registryAdd(const struct memchunk* chunk) {
+  if (debug == false) return;
+  pthread_mutex_lock(&registryLock);
+  if (registry != NULL) g_hash_table_add(registry, (gpointer)chunk);
+  pthread_mutex_unlock(&registryLock);
+}
+
+static void registryRemove(const struct memchunk* chunk) {
+  if (debug == false) return;
+  pthread_mutex_lock(&registryLock);
+  if (registry != NULL) g_hash_table_remove(registry, chunk);
+  pthread_mutex_unlock(&registryLock);
+}
+
+static bool isRegistered(const struct memchunk* chunk) {
+  pthread_mutex_lock(&registryLock);
+  bool found = registry != NULL && g_hash_table_contains(registry, chunk);
+  pthread_mutex_unlock(&registryLock);
+  return found;
+}
+
+/*
+ * Memory must come from rsgMalloc() and friends: the header in front of any
+ * other pointer isn't ours to read (see rsgFree()). In debug mode, pointers
+ * are checked against the registered chunks first. In any mode, one whose
+ * header isn't that of a live chunk, e.g. freed twice, is reported and left
+ * alone rather than unlinked.
+ */
+static struct memchunk* lookupChunk(void* mem, const char* file, int line) {
+  if (mem == NULL) return NULL;
+  struct memchunk* chunk = MEM_TO_CHUNK(mem);
+  if (debug && isRegistered(chunk) == false) {
+    printf("%s:%d: rsg_malloc: @%p wasn't allocated here; ignored\n", file,
+           line, mem);
+    return NULL;
+  }
+  if (chunk->magic != CHUNK_MAGIC) {
+    printf("%s:%d: rsg_malloc: @%p isn't a live allocation; ignored\n", file,
+           line, mem);
+    return NULL;
+  }
+  return chunk;
+}
 
 void* rsgMallocDbg(size_t size, const char* file, int line) {
-  struct memchunk* chunk = malloc(sizeof(*chunk));
+  struct memheap* heap = getLocalHeap();
+  struct memchunk* chunk = NULL;
+  int sizeClass = sizeClassOf(size);
+
+  pthread_mutex_lock(&heap->lock);
+  if (sizeClass >= 0 && !LIST_EMPTY(&heap->cache[sizeClass])) {
+    chunk = LIST_FIRST(&heap->cache[sizeClass]);
+    LIST_REMOVE(chunk, entries);
+    heap->numCached[sizeClass]--;
+  }
+  pthread_mutex_unlock(&heap->lock);
 
-  chunk->mem = malloc(size);
+  if (chunk == NULL) {
+    chunk = malloc(CHUNK_HEADER_SIZE + capacityOf(size, sizeClass));
+    if (chunk == NULL) return NULL;
+  }
 
+  chunk->heap = heap;
   chunk->size = size;
-  LIST_INSERT_HEAD(&allocations, chunk, entries);
+  chunk->capacity = capacityOf(size, sizeClass);
+  chunk->magic = CHUNK_MAGIC;
+  chunk->sizeClass = sizeClass;
 
   /*
    * Zero out the memory chunk
    */
-  bzero(chunk->mem, chunk->size);
+  bzero(CHUNK_TO_MEM(chunk), chunk->size);
+
+  pthread_mutex_lock(&heap->lock);
+  LIST_INSERT_HEAD(&heap->allocations, chunk, entries);
+  heap->numChunks++;
+  heap->totalBytes += chunk->size;
+  pthread_mutex_unlock(&heap->lock);
+  registryAdd(chunk);
 
   if (debug)
     printf("%s:%d: rsg_malloc: allocation @%p (%zu bytes)\n", file, line, chunk,
            chunk->size);
 
-  return chunk->mem;
+  return CHUNK_TO_MEM(chunk);
 }
 
 void* rsgReallocDbg(void* mem, size_t size, const char* file, int line) {
-  struct memchunk* chunk;
-  LIST_FOREACH(chunk, &allocations, entries) {
-    if (chunk->mem == mem) {
-      size_t oldsize = chunk->size;
-
-      chunk->mem = realloc(chunk->mem, size);
-      chunk->size = size;
+  struct memchunk* chunk = lookupChunk(mem, file, line);
+  if (chunk == NULL) {
+    // no memory to move; malloc
+    return rsgMallocDbg(size, file, line);
+  }
 
-      if (debug)
-        printf("%s:%d: rsg_realloc: @%p (%zu -> %zu bytes)\n", file, line,
-               chunk, oldsize, chunk->size);
+  struct memheap* heap = chunk->heap;
+  struct memchunk* oldChunk = chunk;
+  size_t oldsize = chunk->size;
 
-      return chunk->mem;
+  pthread_mutex_lock(&heap->lock);
+  if (size <= chunk->capacity) {
+    // fits in place
+    chunk->size = size;
+  } else {
+    int sizeClass = sizeClassOf(size);
+    LIST_REMOVE(chunk, entries);
+    struct memchunk* moved =
+        realloc(chunk, CHUNK_HEADER_SIZE + capacityOf(size, sizeClass));
+    if (moved == NULL) {
+      // the old chunk is left as it was, as with realloc()
+      LIST_INSERT_HEAD(&heap->allocations, chunk, entries);
+      pthread_mutex_unlock(&heap->lock);
+      return NULL;
     }
+    chunk = moved;
+    chunk->size = size;
+    chunk->capacity = capacityOf(size, sizeClass);
+    chunk->sizeClass = sizeClass;
+    LIST_INSERT_HEAD(&heap->allocations, chunk, entries);
+  }
+  heap->totalBytes = heap->totalBytes - oldsize + size;
+  pthread_mutex_unlock(&heap->lock);
+  if (chunk != oldChunk) {
+    registryRemove(oldChunk);
+    registryAdd(chunk);
   }
 
-  // chunk that contains 'mem' not found; malloc
-  return rsgMallocDbg(size, file, line);
+  if (debug)
+    printf("%s:%d: rsg_realloc: @%p (%zu -> %zu bytes)\n", file, line, chunk,
+           oldsize, chunk->size);
+
+  return CHUNK_TO_MEM(chunk);
 }
 
 void* rsgCallocDbg(size_t number, size_t size, const char* file, int line) {
@@ -84,43 +307,81 @@ void* rsgCallocDbg(size_t number, size_t size, const char* file, int line) {
 }
 
 void rsgFreeDbg(void* mem, const char* file, int line) {
-  //  if (LIST_EMPTY(&allocations)) return;  // XXX
-
-  struct memchunk* chunk;
-  LIST_FOREACH(chunk, &allocations, entries) {
-    if (chunk->mem == mem) {
-      free(chunk->mem);
-      LIST_REMOVE(chunk, entries);
+  struct memchunk* chunk = lookupChunk(mem, file, line);
+  if (chunk == NULL) return;
+  registryRemove(chunk);
 
-      if (debug)
-        printf("%s:%d: rsg_free: free @%p (%zu bytes)\n", file, line, chunk,
-               chunk->size);
+  struct memheap* heap = chunk->heap;
+  size_t size = chunk->size;
+  bool cached = false;
 
-      return;
-    }
+  pthread_mutex_lock(&heap->lock);
+  LIST_REMOVE(chunk, entries);
+  heap->numChunks--;
+  heap->totalBytes -= size;
+  chunk->magic = CHUNK_MAGIC_FREED;
+  if (chunk->sizeClass >= 0 && !heap->orphaned &&
+      heap->numCached[chunk->sizeClass] < CACHE_MAX_CHUNKS) {
+    LIST_INSERT_HEAD(&heap->cache[chunk->sizeClass], chunk, entries);
+    heap->numCached[chunk->sizeClass]++;
+    cached = true;
   }
-  // not found; XXX not ours, so do not free() it
-  return;
+  pthread_mutex_unlock(&heap->lock);
+
+  if (debug)
+    printf("%s:%d: rsg_free: free @%p (%zu bytes)\n", file, line, chunk, size);
+
+  if (!cached) free(chunk);
 }
 
 void rsgMallocPrintStat(void) {
+  struct memheap* heap;
   struct memchunk* chunk;
   size_t total = 0;
+  size_t numChunks = 0;
 
   printf("Active allocations:\n");
 
-  if (LIST_EMPTY(&allocations)) {
-    printf("No allocations yet.\n");
-    return;
+  pthread_mutex_lock(&heapsLock);
+  LIST_FOREACH(heap, &heaps, entries) {
+    pthread_mutex_lock(&heap->lock);
+    LIST_FOREACH(chunk, &heap->allocations, entries) {
+      printf("Chunk @%p (%zu bytes)\n", chunk, chunk->size);
+    }
+    numChunks += heap->numChunks;
+    total += heap->totalBytes;
+    pthread_mutex_unlock(&heap->lock);
   }
+  pthread_mutex_unlock(&heapsLock);
 
-  LIST_FOREACH(chunk, &allocations, entries) {
-    printf("Chunk @%p (%zu bytes)\n", chunk, chunk->size);
-    total += chunk->size;
+  if (numChunks == 0) {
+    printf("No allocations yet.\n");
+    return;
   }
-  printf("Total memory used: %lu bytes\n", total);
+  printf("Total memory used: %zu bytes in %zu chunks\n", total, numChunks);
 }
 
 void rsgMallocSetDebug(bool value) {
+  struct memheap* heap;
+  struct memchunk* chunk;
+
+  // allocations racing with the switch wait for the registry
+  pthread_mutex_lock(&registryLock);
   debug = value;
+  if (value && registry == NULL) {
+    registry = g_hash_table_new(g_direct_hash, NULL);
+    pthread_mutex_lock(&heapsLock);
+    LIST_FOREACH(heap, &heaps, entries) {
+      pthread_mutex_lock(&heap->lock);
+      LIST_FOREACH(chunk, &heap->allocations, entries) {
+        g_hash_table_add(registry, chunk);
+      }
+      pthread_mutex_unlock(&heap->lock);
+    }
+    pthread_mutex_unlock(&heapsLock);
+  } else if (value == false && registry != NULL) {
+    g_hash_table_destroy(registry);
+    registry = NULL;
+  }
+  pthread_mutex_unlock(&registryLock);
 }
@@ -0,0 +1,720 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <errno.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Mesh files.
+ * The file is mapped into memory and cut into chunks at line boundaries,
+ * which are parsed in two passes on the worker pool (see
+ * rsgUpdateParallelFor()). The first pass counts the elements of each
+ * chunk; from the counts of the chunks before it, every chunk then knows
+ * where its elements go, and the second pass parses them right into place.
+ * Nothing is uploaded here: that is left to the render thread.
+ *
+ * Wavefront OBJ: "v", "vt", "vn" and "f" lines are read, anything else is
+ * ignored. Polygons are split into fans of triangles, negative (relative)
+ * indices are supported. Corners that combine the same position, texture
+ * coordinate and normal become one vertex.
+ *
+ * The binary format is the geometry as it goes to GL: a header, then the
+ * interleaved vertices and the indices, each aligned for direct use. Such a
+ * file is not parsed or copied at all; the mesh data points into the
+ * mapping, which is handed to glBufferData as is. The contents are trusted
+ * to be what rsgMeshFileConvert() wrote, beyond a check of the header and
+ * of the indices: one past the vertices would have GL read out of bounds.
+ */
+
+#define CHUNK_SIZE (1024 * 1024)
+
+#define FILE_MAGIC "RSGM"
+#define FILE_VERSION 1
+#define FILE_BYTE_ORDER 0x01020304
+#define FILE_ALIGNMENT 64
+
+typedef struct {
+  char magic[4];
+  guint32 version;
+  guint32 byteOrder;  // FILE_BYTE_ORDER as written: files aren't portable
+  guint32 layout;     // RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS
+  guint32 indexType;  // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+  guint32 reserved;
+  guint64 numVertices;
+  guint64 numIndices;
+  guint64 vertexOffset;  // from the start of the file
+  guint64 indexOffset;
+  float bounds[6];
+} FileHeader;
+
+G_STATIC_ASSERT(sizeof(FileHeader) == 80);
+
+typedef struct {
+  gint32 position;
+  gint32 texcoord;  // -1 if none
+  gint32 normal;    // -1 if none
+} Corner;
+
+typedef struct {
+  float* positions;
+  float* texcoords;
+  float* normals;
+  Corner* corners;  // three per triangle
+  size_t numPositions;
+  size_t numTexcoords;
+  size_t numNormals;
+  size_t numTriangles;
+} Obj;
+
+typedef struct {
+  Obj* obj;
+  const char* begin;
+  const char* end;
+  // counts, then the counts of the chunks before this one
+  size_t numPositions;
+  size_t numTexcoords;
+  size_t numNormals;
+  size_t numTriangles;
+  size_t numLines;
+  size_t errorLine;  // 1-based, in the chunk; 0 if none
+} Chunk;
+
+/*
+ * Scanning; the mapped file isn't NUL terminated, so everything stops at the
+ * end of the line
+ */
+static const char* skipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+static const char* lineEnd(const char* p, const char* end) {
+  const char* newline = memchr(p, '\n', end - p);
+  return newline != NULL ? newline : end;
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool isKeyword(const char* p, const char* end, const char* keyword) {
+  size_t length = strlen(keyword);
+  return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 &&
+         isSpace(p[length]);
+}
+
+static const char* parseInt(const char* p, const char* end, long* value) {
+  bool negative = false;
+  long result = 0;
+  if (p < end && *p == '-') {
+    negative = true;
+    p++;
+  }
+  if (p == end || isDigit(*p) == false) return NULL;
+  while (p < end && isDigit(*p)) {
+    if (result > G_MAXINT32) return NULL;
+    result = result * 10 + (*p++ - '0');
+  }
+  *value = negative ? -result : result;
+  return p;
+}
+
+static const char* parseFloat(const char* p, const char* end, float* value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16};
+  bool negative = false;
+  guint64 mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  for (; p < end && isDigit(*p); p++, digits++) {
+    // digits beyond what a double holds only scale the value
+    if (mantissa < G_GUINT64_CONSTANT(100000000000000000))
+      mantissa = mantissa * 10 + (*p - '0');
+    else
+      exponent++;
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++, digits++) {
+      if (mantissa < G_GUINT64_CONSTANT(100000000000000000)) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (digits == 0) return NULL;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    long e;
+    p = parseInt(p + 1 < end && p[1] == '+' ? p + 2 : p + 1, end, &e);
+    if (p == NULL) return NULL;
+    exponent += (int)CLAMP(e, -400, 400);
+  }
+
+  double result = (double)mantissa;
+  while (exponent > 16) {
+    result *= 1e16;
+    exponent -= 16;
+  }
+  while (exponent < -16) {
+    result /= 1e16;
+    exponent += 16;
+  }
+  result =
+      exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+  *value = (float)(negative ? -result : result);
+  return p;
+}
+
+static const char* parseFloats(const char* p,
+                               const char* end,
+                               float* values,
+                               int minValues,
+                               int maxValues) {
+  int i;
+  for (i = 0; i < maxValues; i++) {
+    p = skipSpace(p, end);
+    if (p == end || *p == '#') break;
+    p = parseFloat(p, end, &values[i]);
+    if (p == NULL || (p < end && isSpace(*p) == false)) return NULL;
+  }
+  if (i < minValues) return NULL;
+  for (; i < maxValues; i++) values[i] = 0.0f;
+  return p;
+}
+
+/*
+ * One index of a face corner: 1-based, or negative counting back from the
+ * last element defined so far
+ */
+static bool resolveIndex(long index, size_t defined, size_t total,
+                         gint32* resolved) {
+  if (index > 0 && (size_t)index <= total)
+    *resolved = (gint32)(index - 1);
+  else if (index < 0 && (size_t)-index <= defined)
+    *resolved = (gint32)(defined + index);
+  else
+    return false;
+  return true;
+}
+
+static const char* parseCorner(const char* p,
+                               const char* end,
+                               const Chunk* chunk,
+                               Corner* corner) {
+  const Obj* obj = chunk->obj;
+  long index;
+
+  p = parseInt(p, end, &index);
+  if (p == NULL || resolveIndex(index, chunk->numPositions, obj->numPositions,
+                                &corner->position) == false)
+    return NULL;
+  corner->texcoord = -1;
+  corner->normal = -1;
+  if (p == end || *p != '/') return p;
+
+  // v/vt, v/vt/vn or v//vn
+  if (++p < end && *p != '/') {
+    p = parseInt(p, end, &index);
+    if (p == NULL || resolveIndex(index, chunk->numTexcoords,
+                                  obj->numTexcoords,
+                                  &corner->texcoord) == false)
+      return NULL;
+  }
+  if (p == end || *p != '/') return p;
+  p = parseInt(p + 1, end, &index);
+  if (p == NULL || resolveIndex(index, chunk->numNormals, obj->numNormals,
+                                &corner->normal) == false)
+    return NULL;
+  return p;
+}
+
+/*
+ * First pass
+ */
+static size_t countCorners(const char* p, const char* end) {
+  size_t count = 0;
+  for (;;) {
+    p = skipSpace(p, end);
+    if (p == end || *p == '#') return count;
+    count++;
+    while (p < end && isSpace(*p) == false) p++;
+  }
+}
+
+static void countChunk(void* data) {
+  Chunk* chunk = data;
+  const char* p = chunk->begin;
+  while (p < chunk->end) {
+    const char* end = lineEnd(p, chunk->end);
+    p = skipSpace(p, end);
+    if (isKeyword(p, end, "v"))
+      chunk->numPositions++;
+    else if (isKeyword(p, end, "vt"))
+      chunk->numTexcoords++;
+    else if (isKeyword(p, end, "vn"))
+      chunk->numNormals++;
+    else if (isKeyword(p, end, "f")) {
+      size_t corners = countCorners(p + 1, end);
+      if (corners >= 3) chunk->numTriangles += corners - 2;
+    }
+    chunk->numLines++;
+    p = end + 1;
+  }
+}
+
+/*
+ * Second pass; the counts of the chunk now locate its elements, and are
+ * advanced as they are parsed
+ */
+static bool parseFace(const char* p, const char* end, Chunk* chunk) {
+  Corner* corners = chunk->obj->corners + chunk->numTriangles * 3;
+  Corner first = {0, -1, -1};
+  Corner previous = first;
+  Corner corner;
+  size_t n;
+
+  for (n = 0;; n++) {
+    p = skipSpace(p, end);
+    if (p == end || *p == '#') break;
+    p = parseCorner(p, end, chunk, &corner);
+    if (p == NULL || (p < end && isSpace(*p) == false)) return false;
+    if (n == 0) first = corner;
+    if (n >= 2) {
+      // fan around the first corner
+      *corners++ = first;
+      *corners++ = previous;
+      *corners++ = corner;
+    }
+    previous = corner;
+  }
+  if (n < 3) return false;
+  chunk->numTriangles += n - 2;
+  return true;
+}
+
+static void parseChunk(void* data) {
+  Chunk* chunk = data;
+  Obj* obj = chunk->obj;
+  const char* p = chunk->begin;
+  size_t line = 0;
+
+  while (p < chunk->end && chunk->errorLine == 0) {
+    const char* end = lineEnd(p, chunk->end);
+    bool ok = true;
+    line++;
+    p = skipSpace(p, end);
+    if (isKeyword(p, end, "v")) {
+      ok = parseFloats(p + 1, end, obj->positions + chunk->numPositions * 3,
+                       3, 3) != NULL;
+      chunk->numPositions++;
+    } else if (isKeyword(p, end, "vt")) {
+      ok = parseFloats(p + 2, end, obj->texcoords + chunk->numTexcoords * 2,
+                       1, 2) != NULL;
+      chunk->numTexcoords++;
+    } else if (isKeyword(p, end, "vn")) {
+      ok = parseFloats(p + 2, end, obj->normals + chunk->numNormals * 3, 3,
+                       3) != NULL;
+      chunk->numNormals++;
+    } else if (isKeyword(p, end, "f")) {
+      ok = parseFace(p + 1, end, chunk);
+    }
+    if (ok == false) chunk->errorLine = line;
+    p = end + 1;
+  }
+}
+
+/*
+ * Assembly
+ */
+static guint hashCorner(const Corner* corner) {
+  return (guint)corner->position * 73856093u ^
+         (guint)corner->texcoord * 19349663u ^
+         (guint)corner->normal * 83492791u;
+}
+
+static bool sameCorner(const Corner* a, const Corner* b) {
+  return a->position == b->position && a->texcoord == b->texcoord &&
+         a->normal == b->normal;
+}
+
+static void copyAttribute(float* vertex,
+                          const float* values,
+                          gint32 index,
+                          size_t size) {
+  if (index >= 0)
+    memcpy(vertex, values + index * size, size * sizeof(float));
+  else
+    memset(vertex, 0, size * sizeof(float));
+}
+
+static void computeBounds(RsgMeshData* data) {
+  const size_t stride = rsgMeshDataGetStride(data);
+  size_t i;
+  int axis;
+  data->bounds[0] = (vec3s){{FLT_MAX, FLT_MAX, FLT_MAX}};
+  data->bounds[1] = (vec3s){{-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+  for (i = 0; i < data->numVertices; i++) {
+    const float* position = data->vertices + i * stride;
+    for (axis = 0; axis < 3; axis++) {
+      data->bounds[0].raw[axis] =
+          MIN(data->bounds[0].raw[axis], position[axis]);
+      data->bounds[1].raw[axis] =
+          MAX(data->bounds[1].raw[axis], position[axis]);
+    }
+  }
+}
+
+static RsgMeshData* assemble(Obj* obj) {
+  const size_t numCorners = obj->numTriangles * 3;
+  RsgMeshData* data = rsgCalloc(1, sizeof(*data));
+  GLuint* indices = rsgMalloc(numCorners * sizeof(*indices));
+  size_t i;
+
+  data->indexType = GL_UNSIGNED_INT;
+  data->indices = indices;
+  data->numIndices = numCorners;
+  if (obj->numTexcoords > 0) data->layout |= RSG_MESH_TEXCOORDS;
+  if (obj->numNormals > 0) data->layout |= RSG_MESH_NORMALS;
+
+  if (data->layout == 0) {
+    // positions only: they are the vertices already
+    data->vertices = obj->positions;
+    data->numVertices = obj->numPositions;
+    obj->positions = NULL;
+    for (i = 0; i < numCorners; i++)
+      indices[i] = (GLuint)obj->corners[i].position;
+    computeBounds(data);
+    return data;
+  }
+
+  /*
+   * One vertex per distinct combination of indices, looked up in an open
+   * addressing table of vertex numbers (twice as large as there are corners)
+   */
+  const size_t stride = rsgMeshDataGetStride(data);
+  size_t capacity = 1;
+  while (capacity < numCorners * 2) capacity <<= 1;
+  gint32* table = rsgMalloc(capacity * sizeof(*table));
+  Corner* unique = rsgMalloc(numCorners * sizeof(*unique));
+  memset(table, 0xff, capacity * sizeof(*table));
+
+  for (i = 0; i < numCorners; i++) {
+    const Corner* corner = &obj->corners[i];
+    size_t slot = hashCorner(corner) & (capacity - 1);
+    while (table[slot] != -1 &&
+           sameCorner(&unique[table[slot]], corner) == false)
+      slot = (slot + 1) & (capacity - 1);
+    if (table[slot] == -1) {
+      table[slot] = (gint32)data->numVertices;
+      unique[data->numVertices++] = *corner;
+    }
+    indices[i] = (GLuint)table[slot];
+  }
+  rsgFree(table);
+
+  data->vertices =
+      rsgMalloc(data->numVertices * stride * sizeof(*data->vertices));
+  for (i = 0; i < data->numVertices; i++) {
+    float* vertex = data->vertices + i * stride;
+    copyAttribute(vertex, obj->positions, unique[i].position, 3);
+    vertex += 3;
+    if (data->layout & RSG_MESH_NORMALS) {
+      copyAttribute(vertex, obj->normals, unique[i].normal, 3);
+      vertex += 3;
+    }
+    if (data->layout & RSG_MESH_TEXCOORDS)
+      copyAttribute(vertex, obj->texcoords, unique[i].texcoord, 2);
+  }
+  rsgFree(unique);
+  computeBounds(data);
+  return data;
+}
+
+static RsgMeshData* loadObj(const char* path,
+                            const char* contents,
+                            size_t length) {
+  Obj obj = {NULL};
+  RsgMeshData* data = NULL;
+  size_t numChunks = 0;
+  size_t i;
+
+  /*
+   * Cut at the first line break after every CHUNK_SIZE bytes
+   */
+  Chunk* chunks = rsgCalloc(length / CHUNK_SIZE + 1, sizeof(*chunks));
+  const char* p = contents;
+  const char* end = contents + length;
+  while (p < end) {
+    const char* chunkEnd = end;
+    if ((size_t)(end - p) > CHUNK_SIZE) {
+      chunkEnd = memchr(p + CHUNK_SIZE, '\n', end - (p + CHUNK_SIZE));
+      chunkEnd = chunkEnd != NULL ? chunkEnd + 1 : end;
+    }
+    chunks[numChunks].obj = &obj;
+    chunks[numChunks].begin = p;
+    chunks[numChunks].end = chunkEnd;
+    numChunks++;
+    p = chunkEnd;
+  }
+
+  rsgUpdateParallelFor(countChunk, chunks, sizeof(*chunks), numChunks);
+
+  // each chunk starts where the ones before it end
+  size_t lines = 0;
+  for (i = 0; i < numChunks; i++) {
+    Chunk* chunk = &chunks[i];
+    size_t counts[5] = {chunk->numPositions, chunk->numTexcoords,
+                        chunk->numNormals, chunk->numTriangles,
+                        chunk->numLines};
+    chunk->numPositions = obj.numPositions;
+    chunk->numTexcoords = obj.numTexcoords;
+    chunk->numNormals = obj.numNormals;
+    chunk->numTriangles = obj.numTriangles;
+    chunk->numLines = lines;
+    obj.numPositions += counts[0];
+    obj.numTexcoords += counts[1];
+    obj.numNormals += counts[2];
+    obj.numTriangles += counts[3];
+    lines += counts[4];
+  }
+  if (obj.numTriangles == 0 || obj.numPositions > G_MAXINT32 ||
+      obj.numTriangles * 3 > G_MAXINT32) {
+    g_warning("Mesh file '%s': no faces, or too many", path);
+    rsgFree(chunks);
+    return NULL;
+  }
+
+  obj.positions = rsgMalloc(obj.numPositions * 3 * sizeof(float));
+  obj.texcoords = rsgMalloc(obj.numTexcoords * 2 * sizeof(float));
+  obj.normals = rsgMalloc(obj.numNormals * 3 * sizeof(float));
+  obj.corners = rsgMalloc(obj.numTriangles * 3 * sizeof(Corner));
+
+  rsgUpdateParallelFor(parseChunk, chunks, sizeof(*chunks), numChunks);
+
+  for (i = 0; i < numChunks; i++) {
+    if (chunks[i].errorLine != 0) {
+      g_warning("Mesh file '%s': malformed line %zu", path,
+                chunks[i].numLines + chunks[i].errorLine);
+      break;
+    }
+  }
+  if (i == numChunks) data = assemble(&obj);
+
+  rsgFree(obj.positions);  // NULL if taken over
+  rsgFree(obj.texcoords);
+  rsgFree(obj.normals);
+  rsgFree(obj.corners);
+  rsgFree(chunks);
+  return data;
+}
+
+/*
+ * Binary format
+ */
+static bool checkBlob(guint64 offset, guint64 count, guint64 size,
+                      size_t length) {
+  return offset % FILE_ALIGNMENT == 0 && offset <= length &&
+         count <= (length - offset) / size;
+}
+
+static bool checkIndices(const RsgMeshData* data) {
+  size_t max = 0;
+  size_t i;
+  if (data->numIndices == 0) return true;
+  if (data->indexType == GL_UNSIGNED_SHORT) {
+    const GLushort* indices = data->indices;
+    for (i = 0; i < data->numIndices; i++) max = MAX(max, indices[i]);
+  } else {
+    const GLuint* indices = data->indices;
+    for (i = 0; i < data->numIndices; i++) max = MAX(max, indices[i]);
+  }
+  return max < data->numVertices;
+}
+
+static RsgMeshData* loadBinary(const char* path,
+                               GMappedFile* file,
+                               const char* contents,
+                               size_t length) {
+  FileHeader header;
+  RsgMeshData probe;
+
+  memcpy(&header, contents, sizeof(header));
+  probe.layout = header.layout;
+  probe.indexType = header.indexType;
+  if (header.version != FILE_VERSION || header.byteOrder != FILE_BYTE_ORDER ||
+      (header.layout & ~(RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS)) != 0 ||
+      (header.indexType != GL_UNSIGNED_INT &&
+       header.indexType != GL_UNSIGNED_SHORT) ||
+      header.numIndices > G_MAXINT32 ||
+      checkBlob(header.vertexOffset, header.numVertices,
+                rsgMeshDataGetStride(&probe) * sizeof(float),
+                length) == false ||
+      checkBlob(header.indexOffset, header.numIndices,
+                rsgMeshDataGetIndexSize(&probe), length) == false) {
+    g_warning("Mesh file '%s': bad header", path);
+    return NULL;
+  }
+
+  RsgMeshData* data = rsgCalloc(1, sizeof(*data));
+  data->layout = header.layout;
+  data->vertices = (float*)(contents + header.vertexOffset);
+  data->numVertices = header.numVertices;
+  data->indexType = header.indexType;
+  data->indices = (void*)(contents + header.indexOffset);
+  data->numIndices = header.numIndices;
+  memcpy(data->bounds, header.bounds, sizeof(data->bounds));
+  if (checkIndices(data) == false) {
+    g_warning("Mesh file '%s': index out of range", path);
+    rsgFree(data);
+    return NULL;
+  }
+  data->mapping = g_mapped_file_ref(file);
+  return data;
+}
+
+static guint64 align(guint64 offset) {
+  return (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+}
+
+static void writePadding(FILE* file, guint64 from, guint64 to) {
+  static const char zeros[FILE_ALIGNMENT] = {0};
+  fwrite(zeros, 1, to - from, file);
+}
+
+static bool writeBinary(const RsgMeshData* data, FILE* file) {
+  const size_t vertexSize = rsgMeshDataGetStride(data) * sizeof(float);
+  const size_t indexSize = rsgMeshDataGetIndexSize(data);
+  FileHeader header = {.magic = FILE_MAGIC,
+                       .version = FILE_VERSION,
+                       .byteOrder = FILE_BYTE_ORDER,
+                       .layout = data->layout,
+                       .indexType = data->indexType,
+                       .numVertices = data->numVertices,
+                       .numIndices = data->numIndices};
+  const guint64 verticesEnd =
+      align(sizeof(header)) + data->numVertices * vertexSize;
+  header.vertexOffset = align(sizeof(header));
+  header.indexOffset = align(verticesEnd);
+  memcpy(header.bounds, data->bounds, sizeof(header.bounds));
+
+  fwrite(&header, sizeof(header), 1, file);
+  writePadding(file, sizeof(header), header.vertexOffset);
+  fwrite(data->vertices, vertexSize, data->numVertices, file);
+  writePadding(file, verticesEnd, header.indexOffset);
+  fwrite(data->indices, indexSize, data->numIndices, file);
+  return ferror(file) == 0;
+}
+
+/*
+ * Internal API
+ */
+size_t rsgMeshDataGetStride(const RsgMeshData* data) {
+  size_t stride = 3;
+  if (data->layout & RSG_MESH_NORMALS) stride += 3;
+  if (data->layout & RSG_MESH_TEXCOORDS) stride += 2;
+  return stride;
+}
+
+size_t rsgMeshDataGetIndexSize(const RsgMeshData* data) {
+  return data->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort)
+                                              : sizeof(GLuint);
+}
+
+RsgMeshData* rsgMeshDataLoad(const char* path) {
+  GError* error = NULL;
+  GMappedFile* file = g_mapped_file_new(path, FALSE, &error);
+  if (file == NULL) {
+    g_warning("Can't map mesh file '%s': %s", path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  RsgMeshData* data = NULL;
+  const char* contents = g_mapped_file_get_contents(file);
+  size_t length = g_mapped_file_get_length(file);
+  if (length >= sizeof(FileHeader) &&
+      memcmp(contents, FILE_MAGIC, sizeof(FILE_MAGIC) - 1) == 0) {
+    // all of it is going to the GPU: start reading ahead now
+    posix_madvise((void*)contents, length, POSIX_MADV_WILLNEED);
+    data = loadBinary(path, file, contents, length);
+  } else if (g_str_has_suffix(path, ".obj")) {
+    data = loadObj(path, contents, length);
+  } else {
+    g_warning("Mesh file '%s': unknown format", path);
+  }
+  g_mapped_file_unref(file);
+  return data;
+}
+
+void rsgMeshDataDestroy(RsgMeshData* data) {
+  if (data->mapping != NULL) {
+    g_mapped_file_unref(data->mapping);
+  } else {
+    rsgFree(data->vertices);
+    rsgFree(data->indices);
+  }
+  rsgFree(data);
+}
+
+/*
+ * Public API
+ */
+bool rsgMeshFileConvert(const char* inputPath, const char* outputPath) {
+  assert(inputPath != NULL && outputPath != NULL);
+  RsgMeshData* data = rsgMeshDataLoad(inputPath);
+  if (data == NULL) return false;
+
+  // 16-bit indices when they do
+  GLushort* shortIndices = NULL;
+  if (data->indexType == GL_UNSIGNED_INT && data->numVertices <= 65536) {
+    const GLuint* indices = data->indices;
+    size_t i;
+    shortIndices = rsgMalloc(data->numIndices * sizeof(*shortIndices));
+    for (i = 0; i < data->numIndices; i++)
+      shortIndices[i] = (GLushort)indices[i];
+    if (data->mapping == NULL) rsgFree(data->indices);
+    data->indices = shortIndices;
+    data->indexType = GL_UNSIGNED_SHORT;
+  }
+
+  bool ok = false;
+  FILE* file = fopen(outputPath, "wb");
+  if (file != NULL) {
+    ok = writeBinary(data, file);
+    ok = fclose(file) == 0 && ok;
+  }
+  if (ok == false)
+    g_warning("Can't write mesh file '%s': %s", outputPath, strerror(errno));
+  if (data->mapping != NULL) rsgFree(shortIndices);  // not freed with it
+  rsgMeshDataDestroy(data);
+  return ok;
+}
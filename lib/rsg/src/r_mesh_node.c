@@ -26,7 +26,18 @@
  * Mesh node.
  * Actually draws the geometry in OpenGL using values from the local context.
  *
- * Properties: none
+ * Mesh nodes may share geometry (see rsgMeshNodeCreateShared()). Runs of
+ * sibling meshes that share geometry are collapsed into a single instanced
+ * draw at compile time; the world matrices of the meshes ("u_model" of the
+ * local context times "model") are streamed into an instance buffer and fed
+ * to the "a_model" vertex attribute, if the program has one. Otherwise they
+ * are uploaded one by one to "u_model".
+ *
+ * Meshes outside of the view frustum (tested with the bounding box of their
+ * geometry) are not drawn.
+ *
+ * Properties:
+ * - "model" of mat4s (placement of this mesh instance)
  */
 
 G_DECLARE_FINAL_TYPE(RsgMeshNode,
@@ -37,34 +48,47 @@ G_DECLARE_FINAL_TYPE(RsgMeshNode,
 
 struct _RsgMeshNode {
   RsgAbstractNode abstract;
-  GLuint vao;
+  RsgGeometry* geometry;  // shared
+  vec3s bounds[2];  // of the geometry
+  mat4s model;
+  bool modelChanged;
+
+  // world matrix cache, as in the transform node
+  mat4s world;
+  size_t parentGeneration;
 };
 
 G_DEFINE_TYPE(RsgMeshNode, rsg_mesh_node, RSG_TYPE_ABSTRACT_NODE)
 
-static void process(RsgAbstractNode* node, RsgContext* ctx) {
-  RsgMeshNode* cnode = RSG_MESH_NODE(node);
+enum { PROP_MODEL = 1, N_PROPERTIES };
+
+static GParamSpec* properties[N_PROPERTIES] = {NULL};
+
+/*
+ * Streaming buffer for per-instance model matrices
+ */
+static GLuint instanceBuffer = 0;
 
+static void setupProgram(RsgContext* ctx) {
   /*
    * Actually draw the geometry setting various OpenGL values/shader uniforms
    * from the local context beforehand.
    */
-  /*
-   * TODO: Save current OpenGL state
-   */
+  const RsgShaderProgram* program = ctx->local->program;
 
   // program
-  glUseProgram(ctx->local->program);
-
-  // uniforms
-  GLint uniformLocation;
-  uniformLocation = glGetUniformLocation(ctx->local->program, "u_view");
-  glUniformMatrix4fv(uniformLocation, 1, GL_FALSE,
-                     (GLfloat*)&ctx->local->u_view);
-  uniformLocation = glGetUniformLocation(ctx->local->program, "u_projection");
-  glUniformMatrix4fv(uniformLocation, 1, GL_FALSE,
-                     (GLfloat*)&ctx->local->u_projection);
+  rsgGlUseProgram(ctx->gl, program != NULL ? program->handle : 0);
 
+  // uniforms (locations are resolved once, when the program is linked)
+  if (program != NULL) {
+    const GLint* slots = program->uniformSlots;
+    if (slots[RSG_UNIFORM_VIEW] != -1)
+      rsgGl->UniformMatrix4fv(slots[RSG_UNIFORM_VIEW], 1, GL_FALSE,
+                              (GLfloat*)&ctx->local->u_view);
+    if (slots[RSG_UNIFORM_PROJECTION] != -1)
+      rsgGl->UniformMatrix4fv(slots[RSG_UNIFORM_PROJECTION], 1, GL_FALSE,
+                              (GLfloat*)&ctx->local->u_projection);
+  }
   //  size_t i;
   //  for (i = 0; i < lctx->numUniforms; i++) {
   //    /*
@@ -89,61 +113,253 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
   //                           (GLfloat*)&value->asMat4);
   //    }
   //  }
+}
+
+static void setModel(RsgContext* ctx, const mat4s* model) {
+  const RsgShaderProgram* program = ctx->local->program;
+  if (program == NULL) return;
+
+  if (program->uniformSlots[RSG_UNIFORM_MODEL] != -1)
+    rsgGl->UniformMatrix4fv(program->uniformSlots[RSG_UNIFORM_MODEL], 1,
+                            GL_FALSE, (GLfloat*)model);
+  if (program->instanceModelAttrib != -1) {
+    // constant attribute value, as the instance array is disabled
+    GLuint column;
+    for (column = 0; column < 4; column++)
+      rsgGl->VertexAttrib4fv(program->instanceModelAttrib + column,
+                             model->col[column].raw);
+  }
+}
 
-  // draw
-  glBindVertexArray(cnode->vao);
-  glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, NULL);
+void rsgDrawElements(RsgContext* ctx,
+                     const RsgGeometry* geometry,
+                     const mat4s* model) {
+  setupProgram(ctx);
+  setModel(ctx, model);
+
+  // draw; bindings are left in place for the next draw, the state tracker
+  // elides them if it uses the same program/VAO
+  rsgGlBindVertexArray(ctx->gl, geometry->vao);
+  rsgGl->DrawElementsBaseVertex(GL_TRIANGLES, geometry->count,
+                                geometry->indexType,
+                                (void*)geometry->indexOffset,
+                                geometry->baseVertex);
+  ctx->gl->frameDraws++;
+  ctx->gl->frameInstances++;
+}
+
+void rsgDrawElementsInstanced(RsgContext* ctx,
+                              const RsgGeometry* geometry,
+                              const mat4s* const* models,
+                              size_t numInstances) {
+  const RsgShaderProgram* program = ctx->local->program;
+  size_t i;
+
+  if (program == NULL || program->instanceModelAttrib == -1) {
+    // the program can't take per-instance data; draw one by one
+    for (i = 0; i < numInstances; i++)
+      rsgDrawElements(ctx, geometry, models[i]);
+    return;
+  }
+
+  setupProgram(ctx);
+
+  /*
+   * Stream the model matrices
+   */
+  mat4s* instanceData =
+      rsgArenaAlloc(ctx->frameArena, numInstances * sizeof(*instanceData));
+  for (i = 0; i < numInstances; i++) instanceData[i] = *models[i];
+
+  if (instanceBuffer == 0) rsgGl->GenBuffers(1, &instanceBuffer);
+  rsgGlBindBuffer(ctx->gl, GL_ARRAY_BUFFER, instanceBuffer);
+  rsgGl->BufferData(GL_ARRAY_BUFFER, numInstances * sizeof(*instanceData),
+                    instanceData, GL_STREAM_DRAW);
 
   /*
-   * TODO: Restore OpenGL state
+   * A mat4 attribute takes four consecutive locations, one per column
    */
+  GLuint location = (GLuint)program->instanceModelAttrib;
+  GLuint column;
+  rsgGlBindVertexArray(ctx->gl, geometry->vao);
+  for (column = 0; column < 4; column++) {
+    rsgGl->EnableVertexAttribArray(location + column);
+    rsgGl->VertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE,
+                               sizeof(mat4s),
+                               (void*)(column * sizeof(vec4s)));
+    rsgGl->VertexAttribDivisor(location + column, 1);
+  }
+
+  rsgGl->DrawElementsInstancedBaseVertex(
+      GL_TRIANGLES, geometry->count, geometry->indexType,
+      (void*)geometry->indexOffset, (GLsizei)numInstances,
+      geometry->baseVertex);
+  ctx->gl->frameDraws++;
+  ctx->gl->frameInstances += numInstances;
+
+  // leave the VAO as we found it, for non-instanced draws; the instance
+  // locations are never part of a mesh layout (see program_reflect())
+  for (column = 0; column < 4; column++)
+    rsgGl->DisableVertexAttribArray(location + column);
+}
+
+static const mat4s* getWorld(RsgMeshNode* cnode, RsgContext* ctx) {
+  if (cnode->modelChanged ||
+      cnode->parentGeneration != ctx->local->modelGeneration) {
+    if (ctx->local->modelGeneration == 0)
+      cnode->world = cnode->model;
+    else
+      cnode->world = glms_mat4_mul(ctx->local->u_model, cnode->model);
+    cnode->parentGeneration = ctx->local->modelGeneration;
+    cnode->modelChanged = false;
+  }
+  return &cnode->world;
+}
+
+const mat4s* rsgMeshNodeGetVisibleWorld(RsgAbstractNode* node,
+                                        RsgContext* ctx) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(node);
+  const mat4s* world = getWorld(cnode, ctx);
 
-  // for now, just reset to zeroes
-  glBindVertexArray(0);
-  glUseProgram(0);
+  if (rsgBoundsCull(ctx, cnode->bounds, world)) return NULL;
+  ctx->global->cull.drawn++;
+  return world;
+}
+
+static void update(RsgAbstractNode* node, RsgContext* ctx) {
+  (void)getWorld(RSG_MESH_NODE(node), ctx);
+}
+
+static void process(RsgAbstractNode* node, RsgContext* ctx) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(node);
+  const mat4s* world = rsgMeshNodeGetVisibleWorld(node, ctx);
+  if (world != NULL)
+    rsgDrawElements(ctx, cnode->geometry, world);
+}
+
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(node);
+  rsgRenderListEmit(list,
+                    (RsgOp){.code = RSG_OP_DRAW,
+                            .node = node,
+                            .draw = cnode->geometry});
+}
+
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(node);
+  mat4s world = glms_mat4_mul(*model, cnode->model);
+  rsgBoundsMergeTransformed(box, cnode->bounds, &world);
+  return true;
+}
+
+static void set_property(GObject* object,
+                         guint property_id,
+                         const GValue* value,
+                         GParamSpec* pspec) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(object);
+
+  switch (property_id) {
+    case PROP_MODEL:
+      cnode->model = *(mat4s*)g_value_get_boxed(value);
+      cnode->modelChanged = true;
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+      break;
+  }
+}
+
+static void get_property(GObject* object,
+                         guint property_id,
+                         GValue* value,
+                         GParamSpec* pspec) {
+  RsgMeshNode* cnode = RSG_MESH_NODE(object);
+
+  switch (property_id) {
+    case PROP_MODEL:
+      g_value_set_boxed(value, &cnode->model);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+      break;
+  }
+}
+
+static void changed(RsgAbstractNode* node) {
+  RSG_MESH_NODE(node)->modelChanged = true;
+}
+
+static void finalize(GObject* node) {
+  rsgGeometryUnref(RSG_MESH_NODE(node)->geometry);
+  G_OBJECT_CLASS(rsg_mesh_node_parent_class)->finalize(node);
 }
 
 static void rsg_mesh_node_class_init(RsgMeshNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
-}
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
+  RSG_ABSTRACT_NODE_CLASS(klass)->updateFunc = update;
 
-static void rsg_mesh_node_init(RsgMeshNode* cnode) {}
+  G_OBJECT_CLASS(klass)->set_property = set_property;
+  G_OBJECT_CLASS(klass)->get_property = get_property;
+  G_OBJECT_CLASS(klass)->finalize = finalize;
 
-static GLuint generateTriangle(void) {
-  GLuint vao;
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
+  properties[PROP_MODEL] =
+      g_param_spec_boxed("model", "Model", "Model matrix of this instance",
+                         mat4s_get_type(), G_PARAM_READWRITE);
 
-  GLuint bo;
-  // position data
-  glGenBuffers(1, &bo);
-  glBindBuffer(GL_ARRAY_BUFFER, bo);
-  glEnableVertexAttribArray(0);
-  glBufferData(
-      GL_ARRAY_BUFFER, 9 * sizeof(GLfloat),
-      (float[9]){-0.5f, -0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, -0.5f, 0.0f},
-      GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  g_object_class_install_properties(G_OBJECT_CLASS(klass), N_PROPERTIES,
+                                    properties);
 
-  // index/elements
-  glGenBuffers(1, &bo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 /* trig 1 */ * sizeof(GLuint),
-               (GLuint[3]){0, 1, 2}, GL_STATIC_DRAW);
+  // plain storage for the handle-based accessors
+  rsgPropertySetStorage(properties[PROP_MODEL],
+                        G_STRUCT_OFFSET(RsgMeshNode, model), changed);
+}
 
-  glBindVertexArray(0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);  // bind calls stored in the VAO
+static void rsg_mesh_node_init(RsgMeshNode* cnode) {
+  cnode->model = glms_mat4_identity();
+  cnode->modelChanged = true;
+}
+static RsgNode* create(const RsgMeshData* data) {
+  RsgNode* node = g_object_new(rsg_mesh_node_get_type(), NULL);
 
-  return vao;
+  RSG_MESH_NODE(node)->geometry = rsgGeometryCreate(data);
+  RSG_MESH_NODE(node)->bounds[0] = data->bounds[0];
+  RSG_MESH_NODE(node)->bounds[1] = data->bounds[1];
+  return node;
 }
 
 RsgNode* rsgMeshNodeCreateTriangle(void) {
-  GLuint vao = generateTriangle();
-  assert(vao != 0);
+  RsgMeshData triangle = {
+      .layout = 0,
+      .vertices = (float[9]){-0.5f, -0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f,
+                             -0.5f, 0.0f},
+      .numVertices = 3,
+      .indexType = GL_UNSIGNED_INT,
+      .indices = (GLuint[3]){0, 1, 2},
+      .numIndices = 3,
+      .bounds = {{{-0.5f, -0.5f, 0.0f}}, {{0.5f, 0.5f, 0.0f}}}};
+  return create(&triangle);
+}
+
+RsgNode* rsgMeshNodeCreateFromFile(const char* path) {
+  assert(path != NULL);
+  // parsed on the worker pool (or mapped), uploaded here
+  RsgMeshData* data = rsgMeshDataLoad(path);
+  if (data == NULL) return NULL;
+  RsgNode* node = create(data);
+  rsgMeshDataDestroy(data);
+  return node;
+}
+
+RsgNode* rsgMeshNodeCreateShared(RsgNode* meshNode) {
+  assert(RSG_IS_MESH_NODE(meshNode) != false);
 
   RsgNode* node = g_object_new(rsg_mesh_node_get_type(), NULL);
 
-  RSG_MESH_NODE(node)->vao = vao;
+  RSG_MESH_NODE(node)->geometry =
+      rsgGeometryRef(RSG_MESH_NODE(meshNode)->geometry);
+  RSG_MESH_NODE(node)->bounds[0] = RSG_MESH_NODE(meshNode)->bounds[0];
+  RSG_MESH_NODE(node)->bounds[1] = RSG_MESH_NODE(meshNode)->bounds[1];
   return node;
 }
@@ -28,9 +28,13 @@
  * - "xy" (Read-only) of vec2 (current position)
  * - "xyChange" (Read-only) of vec2 (delta between old and current xy sample)
  *
- * On process:
+ * On poll (once per frame, before traversal):
  * - read mouse position
- * - update fields & notify on props change
+ * - update fields & notify on props change (delivered in the notification
+ *   phase of the frame)
+ *
+ * Nothing to do on process. As the node draws nothing, pointer moves don't
+ * dirty its parents; only what its properties are bound to is redrawn.
  */
 
 G_DECLARE_FINAL_TYPE(RsgMouseManipulatorNode, rsg_mouse_manipulator_node, RSG,
@@ -61,10 +65,13 @@ enum {
 
 static GParamSpec* properties[N_PROPERTIES] = {NULL};
 
-static void process(RsgAbstractNode* node, RsgContext* ctx) {
+static void process(RsgAbstractNode* node, RsgContext* ctx) {}
+
+static void poll(RsgAbstractNode* node, RsgContext* ctx) {
   RsgMouseManipulatorNode* cnode = RSG_MOUSE_MANIPULATOR_NODE(node);
 
   double x, y;
+  if (ctx->global->window == NULL) return;  // no pointer without a window
   glfwGetCursorPos(ctx->global->window, &x, &y);
 
   if (x != cnode->x || y != cnode->y) {
@@ -74,8 +81,8 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
     cnode->x = x;
     cnode->y = y;
     //    printf("Mouse manip: x/y changed to %d, %d\n", cnode->x, cnode->y);
-    g_object_notify_by_pspec(G_OBJECT(node), properties[PROP_X]);
-    g_object_notify_by_pspec(G_OBJECT(node), properties[PROP_Y]);
+    rsgAbstractNodeNotify(node, properties[PROP_X]);
+    rsgAbstractNodeNotify(node, properties[PROP_Y]);
 
     // delta x or delta y has been changed
     if (xChange != cnode->xChange || yChange != cnode->yChange) {
@@ -84,8 +91,8 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
       //      printf("Mouse manip: delta x/y changed to %d, %d\n",
       //      cnode->xChange,
       //             cnode->yChange);
-      g_object_notify_by_pspec(G_OBJECT(node), properties[PROP_X_CHANGE]);
-      g_object_notify_by_pspec(G_OBJECT(node), properties[PROP_Y_CHANGE]);
+      rsgAbstractNodeNotify(node, properties[PROP_X_CHANGE]);
+      rsgAbstractNodeNotify(node, properties[PROP_Y_CHANGE]);
     }
   }
 }
@@ -123,6 +130,9 @@ static void get_property(GObject* object, guint property_id, GValue* value,
 static void rsg_mouse_manipulator_node_class_init(
     RsgMouseManipulatorNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  // draws nothing, so pointer moves only redraw what they are bound to
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = rsgAbstractNodeCompileNothing;
+  RSG_ABSTRACT_NODE_CLASS(klass)->pollFunc = poll;
 
   //  G_OBJECT_CLASS(klass)->set_property = set_property;
   G_OBJECT_CLASS(klass)->get_property = get_property;
@@ -148,20 +158,36 @@ static void rsg_mouse_manipulator_node_class_init(
 
   g_object_class_install_properties(G_OBJECT_CLASS(klass), N_PROPERTIES,
                                     properties);
+
+  // plain storage for the handle-based accessors
+  rsgPropertySetStorage(properties[PROP_X],
+                        G_STRUCT_OFFSET(RsgMouseManipulatorNode, x), NULL);
+  rsgPropertySetStorage(properties[PROP_Y],
+                        G_STRUCT_OFFSET(RsgMouseManipulatorNode, y), NULL);
+  rsgPropertySetStorage(properties[PROP_X_CHANGE],
+                        G_STRUCT_OFFSET(RsgMouseManipulatorNode, xChange),
+                        NULL);
+  rsgPropertySetStorage(properties[PROP_Y_CHANGE],
+                        G_STRUCT_OFFSET(RsgMouseManipulatorNode, yChange),
+                        NULL);
 }
 
 static void rsg_mouse_manipulator_node_init(RsgMouseManipulatorNode* cnode) {
   /*
    * Defaults
    */
-  double xPos, yPos;
-  glfwGetCursorPos(rsgGetGlobalContext()->window, &xPos, &yPos);
+  double xPos = 0.0;
+  double yPos = 0.0;
+  if (rsgGetGlobalContext()->window != NULL)
+    glfwGetCursorPos(rsgGetGlobalContext()->window, &xPos, &yPos);
   //  cnode->xy = (vec2s){xPos, yPos};
   //  cnode->xyChange = (vec2s){0.0f, 0.0f};
   cnode->x = xPos;
   cnode->y = yPos;
   cnode->xChange = 0;
   cnode->yChange = 0;
+
+  rsgAbstractNodeSetPolled(RSG_ABSTRACT_NODE(cnode));
 }
 
 RsgNode* rsgMouseManipulatorNodeCreate(void) {
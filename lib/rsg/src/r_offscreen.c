@@ -0,0 +1,133 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Offscreen rendering without a display server.
+ * An EGL context is made current without any surface (surfaceless Mesa
+ * platform, or the default display with EGL_KHR_surfaceless_context) and
+ * the frames are drawn into a framebuffer object of the requested size.
+ * With no GPU around, Mesa falls back to its software rasterizer.
+ */
+
+static EGLDisplay getDisplay(void) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+          "eglGetPlatformDisplayEXT");
+  EGLDisplay display = EGL_NO_DISPLAY;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  if (getPlatformDisplay != NULL)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                 EGL_DEFAULT_DISPLAY, NULL);
+#endif
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  return display;
+}
+
+static EGLContext createContext(EGLDisplay display) {
+  static const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                         EGL_NONE};
+  // same kind of context GLFW gives the windowed mode
+  static const EGLint contextAttribs[] = {
+      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint numConfigs = 0;
+
+  if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE) return EGL_NO_CONTEXT;
+  if (eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) ==
+          EGL_FALSE ||
+      numConfigs == 0) {
+#ifdef EGL_KHR_no_config_context
+    // the surfaceless platform exposes no configs at all; nothing is drawn
+    // into an EGL surface anyway
+    config = EGL_NO_CONFIG_KHR;
+#else
+    return EGL_NO_CONTEXT;
+#endif
+  }
+  return eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+}
+
+static void createFramebuffer(RsgOffscreen* offscreen) {
+  rsgGl->GenRenderbuffers(1, &offscreen->colorbuffer);
+  rsgGl->BindRenderbuffer(GL_RENDERBUFFER, offscreen->colorbuffer);
+  rsgGl->RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, offscreen->width,
+                             offscreen->height);
+  rsgGl->GenRenderbuffers(1, &offscreen->depthbuffer);
+  rsgGl->BindRenderbuffer(GL_RENDERBUFFER, offscreen->depthbuffer);
+  rsgGl->RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                             offscreen->width, offscreen->height);
+  rsgGl->BindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  rsgGl->GenFramebuffers(1, &offscreen->framebuffer);
+  rsgGl->BindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+  rsgGl->FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_RENDERBUFFER, offscreen->colorbuffer);
+  rsgGl->FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                 GL_RENDERBUFFER, offscreen->depthbuffer);
+  if (rsgGl->CheckFramebufferStatus(GL_FRAMEBUFFER) !=
+      GL_FRAMEBUFFER_COMPLETE)
+    g_error("RSG: offscreen framebuffer incomplete");
+
+  // stays bound: everything is drawn into it
+  rsgGl->Viewport(0, 0, offscreen->width, offscreen->height);
+}
+
+RsgOffscreen* rsgOffscreenCreate(int width, int height) {
+  assert(width > 0 && height > 0);
+  EGLint major, minor;
+
+  EGLDisplay display = getDisplay();
+  if (display == EGL_NO_DISPLAY ||
+      eglInitialize(display, &major, &minor) == EGL_FALSE)
+    g_error("RSG: no EGL display");
+  EGLContext context = createContext(display);
+  if (context == EGL_NO_CONTEXT)
+    g_error("RSG: can't create an EGL OpenGL context");
+  if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) ==
+      EGL_FALSE)
+    g_error("RSG: can't make the EGL context current without a surface");
+
+  // EGL resolves core entry points too (EGL 1.5,
+  // EGL_KHR_get_all_proc_addresses)
+  rsgGlDispatchInit(eglGetProcAddress);
+
+  RsgOffscreen* offscreen = rsgMalloc(sizeof(*offscreen));
+  offscreen->display = display;
+  offscreen->context = context;
+  offscreen->width = width;
+  offscreen->height = height;
+  createFramebuffer(offscreen);
+
+  const GLubyte*(GLAPIENTRY * getString)(GLenum) =
+      (const GLubyte*(GLAPIENTRY*)(GLenum))eglGetProcAddress("glGetString");
+  printf("RSG: offscreen %dx%d, EGL %d.%d (%s)\nRSG: OpenGL context %s\n",
+         width, height, major, minor, eglQueryString(display, EGL_VENDOR),
+         (const char*)getString(GL_VERSION));
+  return offscreen;
+}
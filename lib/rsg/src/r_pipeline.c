@@ -0,0 +1,171 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "rsg_internal.h"
+
+/*
+ * Pipelined frames.
+ * The render state of a frame (local contexts, culled draws with their
+ * world matrices) is resolved into one of two frame packets by a worker
+ * thread, including the update phase. Meanwhile the GL thread submits the
+ * packet of the previous frame, which costs a frame of latency.
+ *
+ * The scene is only modified (queued updates, polling, bindings) while the
+ * worker is idle, so it never sees a half-updated scene. Nodes that must
+ * run on the GL thread (e.g. callbacks) are recorded into the packet and
+ * called at submit time; they must not modify the scene in this mode.
+ */
+
+struct RsgPipeline {
+  RsgPacket packets[2];
+  RsgPacket* ready;  // built and not submitted yet, or NULL
+  bool building;
+  RsgAbstractNode* root;
+  RsgRenderList* rootList;
+  RsgGlobalContext* global;
+  GThread* thread;
+  GAsyncQueue* requests;  // RsgPacket* to build; the pipeline itself to quit
+  GAsyncQueue* done;
+};
+
+static void build(RsgPipeline* pipeline, RsgPacket* packet) {
+  rsgUpdateRun(pipeline->root);
+
+  rsgArenaReset(packet->arena);
+  packet->numEntries = 0;
+  packet->snapshot = NULL;
+
+  RsgContext ctx;
+  ctx.global = pipeline->global;
+  ctx.frameArena = packet->arena;
+  ctx.local = rsgArenaAlloc(packet->arena, sizeof(*ctx.local));
+  ctx.gl = NULL;  // not on this thread
+  rsgLocalContextReset(ctx.local);
+
+  rsgRenderListInvalidate(pipeline->rootList);
+  rsgRenderListResolve(pipeline->rootList, &ctx, packet);
+}
+
+static gpointer worker(gpointer data) {
+  RsgPipeline* pipeline = data;
+  for (;;) {
+    gpointer request = g_async_queue_pop(pipeline->requests);
+    if (request == pipeline) break;
+    build(pipeline, request);
+    g_async_queue_push(pipeline->done, request);
+  }
+  return NULL;
+}
+
+RsgPipeline* rsgPipelineCreate(RsgAbstractNode* root,
+                               RsgRenderList* rootList) {
+  RsgPipeline* pipeline = rsgMalloc(sizeof(*pipeline));
+  size_t i;
+  for (i = 0; i < 2; i++) {
+    pipeline->packets[i].entries = NULL;
+    pipeline->packets[i].numEntries = 0;
+    pipeline->packets[i].capacity = 0;
+    pipeline->packets[i].arena =
+        rsgArenaCreate(rsgGetGlobalContext()->frameArena->size);
+    pipeline->packets[i].snapshot = NULL;
+  }
+  pipeline->ready = NULL;
+  pipeline->building = false;
+  pipeline->root = root;
+  pipeline->rootList = rootList;
+  pipeline->global = rsgGetGlobalContext();
+  pipeline->requests = g_async_queue_new();
+  pipeline->done = g_async_queue_new();
+  pipeline->thread = g_thread_new("rsg-pipeline", worker, pipeline);
+  return pipeline;
+}
+
+void rsgPipelineDestroy(RsgPipeline* pipeline) {
+  rsgPipelineWait(pipeline);
+  g_async_queue_push(pipeline->requests, pipeline);
+  g_thread_join(pipeline->thread);
+  g_async_queue_unref(pipeline->requests);
+  g_async_queue_unref(pipeline->done);
+
+  size_t i;
+  for (i = 0; i < 2; i++) {
+    rsgFree(pipeline->packets[i].entries);
+    rsgArenaDestroy(pipeline->packets[i].arena);
+  }
+  rsgFree(pipeline);
+}
+
+void rsgPipelineBuildAsync(RsgPipeline* pipeline) {
+  assert(pipeline->building == false);
+  RsgPacket* packet = pipeline->ready == &pipeline->packets[0]
+                          ? &pipeline->packets[1]
+                          : &pipeline->packets[0];
+  pipeline->building = true;
+  g_async_queue_push(pipeline->requests, packet);
+}
+
+bool rsgPipelineWait(RsgPipeline* pipeline) {
+  if (pipeline->building == false) return false;
+  pipeline->ready = g_async_queue_pop(pipeline->done);
+  pipeline->building = false;
+  return true;
+}
+
+bool rsgPipelineIsReady(const RsgPipeline* pipeline) {
+  return pipeline->ready != NULL;
+}
+
+bool rsgPipelineSubmit(RsgPipeline* pipeline, RsgContext* ctx) {
+  RsgPacket* packet = pipeline->ready;
+  if (packet == NULL) return false;
+  pipeline->ready = NULL;
+
+  // the packet's arena is free to use until the next build into it
+  RsgLocalContext* local = rsgArenaAlloc(packet->arena, sizeof(*local));
+  ctx->frameArena = packet->arena;
+  ctx->local = local;
+
+  const RsgPacketEntry* entry = packet->entries;
+  const RsgPacketEntry* end = packet->entries + packet->numEntries;
+  for (; entry != end; entry++) {
+    switch (entry->code) {
+      case RSG_PACKET_CLEAR:
+        rsgGlClearColor(ctx->gl, entry->color);
+        rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        break;
+      case RSG_PACKET_DRAW:
+        *local = *entry->local;
+        if (entry->draw.numInstances == 1)
+          rsgDrawElements(ctx, entry->draw.geometry, entry->draw.models[0]);
+        else
+          rsgDrawElementsInstanced(ctx, entry->draw.geometry,
+                                   entry->draw.models,
+                                   entry->draw.numInstances);
+        break;
+      case RSG_PACKET_PROCESS:
+        *local = *entry->local;
+        entry->process.processFunc(entry->process.node, ctx);
+        break;
+    }
+  }
+  return true;
+}
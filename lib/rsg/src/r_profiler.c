@@ -0,0 +1,309 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Per-node profiler.
+ * The profiled replay brackets every op that runs node code with
+ * rsgProfilerEnter()/rsgProfilerLeave(). CPU time is taken from the
+ * monotonic clock; a scope's exclusive time is its inclusive time minus that
+ * of the scopes nested in it (e.g. a group's children).
+ *
+ * GPU time comes from pairs of GL_TIMESTAMP queries, as GL_TIME_ELAPSED
+ * queries can't nest. The queries of a frame are only read back when their
+ * slot in the ring comes round again, RING_SIZE frames later, by which time
+ * the GPU is done with them and reading doesn't stall. Frames whose results
+ * still aren't available are dropped from the GPU totals.
+ *
+ * Everything here runs on the render thread.
+ */
+
+#define RING_SIZE 4
+
+typedef struct {
+  RsgAbstractNode* node;  // NULL once finalized
+  GType type;
+  size_t calls;
+  gint64 cpuInclusive;  // nanoseconds
+  gint64 cpuExclusive;
+  gint64 gpu;
+} Entry;
+
+typedef struct {
+  Entry* entry;
+  gint64 start;
+  gint64 nested;  // inclusive time of the scopes nested in this one
+  guint query;    // index of the begin query in the frame slot
+} Scope;
+
+typedef struct {
+  GArray* queries;  // GLuint, two per record
+  GPtrArray* records;  // Entry, one per pair of queries
+} FrameSlot;
+
+static bool requested = false;
+static bool active = false;
+static bool gpu = false;
+static size_t numFrames = 0;
+static size_t numDroppedFrames = 0;
+
+static GHashTable* entriesByNode = NULL;
+static GPtrArray* entries = NULL;  // including those of finalized nodes
+static GArray* scopes = NULL;
+static FrameSlot ring[RING_SIZE];
+static FrameSlot* slot = NULL;
+
+static gint64 now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static void nodeGone(gpointer data, GObject* node) {
+  Entry* entry = data;
+  g_hash_table_remove(entriesByNode, node);
+  entry->node = NULL;
+}
+
+static Entry* lookupEntry(RsgAbstractNode* node) {
+  Entry* entry = g_hash_table_lookup(entriesByNode, node);
+  if (entry != NULL) return entry;
+
+  entry = rsgMalloc(sizeof(*entry));
+  entry->node = node;
+  entry->type = G_OBJECT_TYPE(node);
+  g_hash_table_insert(entriesByNode, node, entry);
+  g_ptr_array_add(entries, entry);
+  g_object_weak_ref(G_OBJECT(node), nodeGone, entry);
+  return entry;
+}
+
+static void init(void) {
+  int i;
+  entriesByNode = g_hash_table_new(g_direct_hash, g_direct_equal);
+  entries = g_ptr_array_new();
+  scopes = g_array_new(FALSE, FALSE, sizeof(Scope));
+  for (i = 0; i < RING_SIZE; i++) {
+    ring[i].queries = g_array_new(FALSE, FALSE, sizeof(GLuint));
+    ring[i].records = g_ptr_array_new();
+  }
+}
+
+static void readBack(FrameSlot* frame) {
+  if (frame->records->len == 0) return;
+
+  GLuint* queries = &g_array_index(frame->queries, GLuint, 0);
+  GLint available = 0;
+  rsgGl->GetQueryObjectiv(queries[frame->records->len * 2 - 1],
+                          GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available) {
+    guint i;
+    for (i = 0; i < frame->records->len; i++) {
+      Entry* entry = g_ptr_array_index(frame->records, i);
+      GLuint64 begin, end;
+      rsgGl->GetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &begin);
+      rsgGl->GetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+      entry->gpu += end - begin;
+    }
+  } else {
+    numDroppedFrames++;
+  }
+  g_ptr_array_set_size(frame->records, 0);
+}
+
+bool rsgProfilerBeginFrame(void) {
+  active = requested;
+  if (active == false) return false;
+
+  if (entries == NULL) init();
+  gpu = rsgGlHasTimerQuery();
+  slot = &ring[numFrames % RING_SIZE];
+  if (gpu) readBack(slot);
+  numFrames++;
+  return true;
+}
+
+void rsgProfilerEndFrame(void) {
+  assert(active && scopes->len == 0);
+  slot = NULL;
+}
+
+void rsgProfilerEnter(RsgAbstractNode* node) {
+  Scope scope = {lookupEntry(node), 0, 0, 0};
+
+  if (gpu) {
+    guint needed = (slot->records->len + 1) * 2;
+    if (slot->queries->len < needed) {
+      guint have = slot->queries->len;
+      g_array_set_size(slot->queries, needed);
+      rsgGl->GenQueries(needed - have,
+                        &g_array_index(slot->queries, GLuint, have));
+    }
+    scope.query = slot->records->len * 2;
+    g_ptr_array_add(slot->records, scope.entry);
+    rsgGl->QueryCounter(g_array_index(slot->queries, GLuint, scope.query),
+                        GL_TIMESTAMP);
+  }
+
+  scope.start = now();
+  g_array_append_val(scopes, scope);
+}
+
+void rsgProfilerLeave(void) {
+  gint64 end = now();
+  Scope* scope = &g_array_index(scopes, Scope, scopes->len - 1);
+  gint64 inclusive = end - scope->start;
+
+  if (gpu)
+    rsgGl->QueryCounter(g_array_index(slot->queries, GLuint, scope->query + 1),
+                        GL_TIMESTAMP);
+
+  scope->entry->calls++;
+  scope->entry->cpuInclusive += inclusive;
+  scope->entry->cpuExclusive += inclusive - scope->nested;
+  g_array_set_size(scopes, scopes->len - 1);
+  if (scopes->len > 0)
+    g_array_index(scopes, Scope, scopes->len - 1).nested += inclusive;
+}
+
+/*
+ * Public API
+ */
+void rsgProfilerSetEnabled(bool value) {
+  // latched at the start of the next frame
+  requested = value;
+}
+
+void rsgProfilerReset(void) {
+  int i;
+  if (entries == NULL) return;
+  assert(slot == NULL);  // not mid-frame
+
+  for (i = 0; i < RING_SIZE; i++) g_ptr_array_set_size(ring[i].records, 0);
+  g_hash_table_remove_all(entriesByNode);
+  while (entries->len > 0) {
+    Entry* entry = g_ptr_array_index(entries, entries->len - 1);
+    if (entry->node != NULL)
+      g_object_weak_unref(G_OBJECT(entry->node), nodeGone, entry);
+    rsgFree(entry);
+    g_ptr_array_set_size(entries, entries->len - 1);
+  }
+  numFrames = 0;
+  numDroppedFrames = 0;
+}
+
+size_t rsgProfilerGetNumFrames(void) {
+  return numFrames;
+}
+
+static void entryToStat(const Entry* entry, RsgProfileStat* stat) {
+  stat->node = (RsgNode*)entry->node;
+  stat->typeName = g_type_name(entry->type);
+  stat->calls = entry->calls;
+  stat->cpuInclusiveMs = entry->cpuInclusive / 1e6;
+  stat->cpuExclusiveMs = entry->cpuExclusive / 1e6;
+  stat->gpuMs = entry->gpu / 1e6;
+}
+
+size_t rsgProfilerGetNodeStat(RsgProfileStat* stats, size_t maxStats) {
+  size_t i;
+  if (entries == NULL) return 0;
+  for (i = 0; i < entries->len && i < maxStats; i++)
+    entryToStat(g_ptr_array_index(entries, i), &stats[i]);
+  return entries->len;
+}
+
+static GArray* aggregateTypes(void) {
+  GArray* types = g_array_new(FALSE, FALSE, sizeof(Entry));
+  GHashTable* indices = g_hash_table_new(g_direct_hash, g_direct_equal);
+  guint i;
+
+  for (i = 0; i < entries->len; i++) {
+    const Entry* entry = g_ptr_array_index(entries, i);
+    gpointer index;
+    Entry* type;
+    if (g_hash_table_lookup_extended(indices, (gpointer)entry->type, NULL,
+                                     &index)) {
+      type = &g_array_index(types, Entry, GPOINTER_TO_UINT(index));
+    } else {
+      Entry empty = {NULL, entry->type, 0, 0, 0, 0};
+      g_hash_table_insert(indices, (gpointer)entry->type,
+                          GUINT_TO_POINTER(types->len));
+      g_array_append_val(types, empty);
+      type = &g_array_index(types, Entry, types->len - 1);
+    }
+    type->calls += entry->calls;
+    type->cpuInclusive += entry->cpuInclusive;
+    type->cpuExclusive += entry->cpuExclusive;
+    type->gpu += entry->gpu;
+  }
+  g_hash_table_destroy(indices);
+  return types;
+}
+
+size_t rsgProfilerGetTypeStat(RsgProfileStat* stats, size_t maxStats) {
+  size_t i;
+  if (entries == NULL) return 0;
+
+  GArray* types = aggregateTypes();
+  size_t numTypes = types->len;
+  for (i = 0; i < numTypes && i < maxStats; i++)
+    entryToStat(&g_array_index(types, Entry, i), &stats[i]);
+  g_array_free(types, TRUE);
+  return numTypes;
+}
+
+static void printEntry(const Entry* entry, double frames) {
+  printf("  %-28s %10.3f %10.3f %10.3f %8.1f\n", g_type_name(entry->type),
+         entry->cpuInclusive / 1e6 / frames,
+         entry->cpuExclusive / 1e6 / frames, entry->gpu / 1e6 / frames,
+         entry->calls / frames);
+}
+
+void rsgProfilerPrintStat(void) {
+  guint i;
+  if (entries == NULL || numFrames == 0) {
+    printf("No profiled frames yet.\n");
+    return;
+  }
+
+  double frames = numFrames;
+  printf("Profile over %zu frames (%zu dropped from GPU times), "
+         "ms per frame:\n", numFrames, numDroppedFrames);
+  printf("  %-28s %10s %10s %10s %8s\n", "node", "cpu incl", "cpu excl",
+         "gpu", "calls");
+  for (i = 0; i < entries->len; i++) {
+    const Entry* entry = g_ptr_array_index(entries, i);
+    printf("  @%p%s\n", (void*)entry->node,
+           entry->node == NULL ? " (finalized)" : "");
+    printEntry(entry, frames);
+  }
+
+  GArray* types = aggregateTypes();
+  printf("Per node type:\n");
+  for (i = 0; i < types->len; i++)
+    printEntry(&g_array_index(types, Entry, i), frames);
+  g_array_free(types, TRUE);
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Property handles.
+ * A handle is resolved once from a (node type, name) pair and interned, so
+ * the typed setters and getters need no string lookups. Node classes may
+ * describe where a property lives in the instance (see rsgPropertySetStorage()),
+ * in which case the value is copied in place, followed by the class' change
+ * hook. Other properties go straight to the class' set_property/get_property
+ * with a stack GValue; boxed values are passed as static, so setting never
+ * touches the heap. Either way, values are validated against the GParamSpec
+ * first (numbers clamped to its range), as g_object_set_property() would.
+ *
+ * Changes are announced with rsgAbstractNodeNotify(), i.e. coalesced until
+ * the notification phase of the frame.
+ */
+
+struct RsgProperty {
+  GParamSpec* pspec;
+  RsgValueType type;
+  gssize offset;  // of the storage in the instance, -1 if there is none
+  void (*changedFunc)(RsgAbstractNode* node);
+};
+
+static GHashTable* properties = NULL;  // GParamSpec* -> RsgProperty*
+G_LOCK_DEFINE_STATIC(properties);  // handles may be looked up off-thread
+
+static const size_t valueSizes[] = {
+    [RSG_VALUE_POINTER] = sizeof(void*), [RSG_VALUE_INT] = sizeof(int),
+    [RSG_VALUE_FLOAT] = sizeof(float),   [RSG_VALUE_VEC2] = sizeof(vec2s),
+    [RSG_VALUE_VEC3] = sizeof(vec3s),    [RSG_VALUE_VEC4] = sizeof(vec4s),
+    [RSG_VALUE_MAT4] = sizeof(mat4s),
+};
+
+static RsgValueType valueTypeOf(GType type) {
+  if (type == G_TYPE_POINTER) return RSG_VALUE_POINTER;
+  if (type == G_TYPE_INT) return RSG_VALUE_INT;
+  if (type == G_TYPE_FLOAT) return RSG_VALUE_FLOAT;
+  if (type == vec2s_get_type()) return RSG_VALUE_VEC2;
+  if (type == vec3s_get_type()) return RSG_VALUE_VEC3;
+  if (type == vec4s_get_type()) return RSG_VALUE_VEC4;
+  if (type == mat4s_get_type()) return RSG_VALUE_MAT4;
+  g_error("Unsupported property type '%s'", g_type_name(type));
+}
+
+static RsgProperty* intern(GParamSpec* pspec) {
+  G_LOCK(properties);
+  if (properties == NULL)
+    properties = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  RsgProperty* prop = g_hash_table_lookup(properties, pspec);
+  if (prop == NULL) {
+    prop = rsgMalloc(sizeof(*prop));
+    prop->pspec = pspec;
+    prop->type = valueTypeOf(pspec->value_type);
+    prop->offset = -1;
+    prop->changedFunc = NULL;
+    g_hash_table_insert(properties, pspec, prop);
+  }
+  G_UNLOCK(properties);
+  return prop;
+}
+
+void rsgPropertySetStorage(GParamSpec* pspec,
+                           gssize offset,
+                           void (*changedFunc)(RsgAbstractNode* node)) {
+  RsgProperty* prop = intern(pspec);
+  prop->offset = offset;
+  prop->changedFunc = changedFunc;
+}
+
+/*
+ * Numbers are clamped to the range of their GParamSpec, as
+ * g_param_value_validate() would, without going through a GValue
+ */
+static void storeValue(const RsgProperty* prop,
+                       void* field,
+                       const void* data) {
+  GParamSpec* pspec = prop->pspec;
+  if (prop->type == RSG_VALUE_INT && G_IS_PARAM_SPEC_INT(pspec)) {
+    *(int*)field = CLAMP(*(const int*)data, G_PARAM_SPEC_INT(pspec)->minimum,
+                         G_PARAM_SPEC_INT(pspec)->maximum);
+  } else if (prop->type == RSG_VALUE_FLOAT && G_IS_PARAM_SPEC_FLOAT(pspec)) {
+    *(float*)field =
+        CLAMP(*(const float*)data, G_PARAM_SPEC_FLOAT(pspec)->minimum,
+              G_PARAM_SPEC_FLOAT(pspec)->maximum);
+  } else {
+    memcpy(field, data, valueSizes[prop->type]);
+  }
+}
+
+static void setValue(RsgAbstractNode* node,
+                     const RsgProperty* prop,
+                     const void* data) {
+  assert(prop->pspec->flags & G_PARAM_WRITABLE);
+
+  if (prop->offset != -1) {
+    storeValue(prop, (char*)node + prop->offset, data);
+    if (prop->changedFunc != NULL) prop->changedFunc(node);
+  } else {
+    GValue gvalue = G_VALUE_INIT;
+    g_value_init(&gvalue, prop->pspec->value_type);
+    if (prop->type == RSG_VALUE_POINTER)
+      g_value_set_pointer(&gvalue, *(void* const*)data);
+    else if (prop->type == RSG_VALUE_INT)
+      g_value_set_int(&gvalue, *(const int*)data);
+    else if (prop->type == RSG_VALUE_FLOAT)
+      g_value_set_float(&gvalue, *(const float*)data);
+    else
+      g_value_set_static_boxed(&gvalue, data);
+
+    // what g_object_set_property() checks on the way
+    g_param_value_validate(prop->pspec, &gvalue);
+    GObjectClass* klass = g_type_class_peek(prop->pspec->owner_type);
+    klass->set_property(G_OBJECT(node), prop->pspec->param_id, &gvalue,
+                        prop->pspec);
+  }
+  rsgAbstractNodeNotify(node, prop->pspec);
+}
+
+static void getValue(RsgAbstractNode* node,
+                     const RsgProperty* prop,
+                     void* data) {
+  assert(prop->pspec->flags & G_PARAM_READABLE);
+
+  if (prop->offset != -1) {
+    memcpy(data, (const char*)node + prop->offset, valueSizes[prop->type]);
+    return;
+  }
+
+  GValue gvalue = G_VALUE_INIT;
+  g_value_init(&gvalue, prop->pspec->value_type);
+  GObjectClass* klass = g_type_class_peek(prop->pspec->owner_type);
+  klass->get_property(G_OBJECT(node), prop->pspec->param_id, &gvalue,
+                      prop->pspec);
+  if (prop->type == RSG_VALUE_POINTER)
+    *(void**)data = g_value_get_pointer(&gvalue);
+  else if (prop->type == RSG_VALUE_INT)
+    *(int*)data = g_value_get_int(&gvalue);
+  else if (prop->type == RSG_VALUE_FLOAT)
+    *(float*)data = g_value_get_float(&gvalue);
+  else
+    memcpy(data, g_value_get_boxed(&gvalue), valueSizes[prop->type]);
+  g_value_unset(&gvalue);
+}
+
+static RsgAbstractNode* checkedNode(RsgNode* node,
+                                    const RsgProperty* prop,
+                                    RsgValueType type) {
+  assert(prop != NULL);
+  assert(prop->type == type);
+  assert(G_TYPE_CHECK_INSTANCE_TYPE(node, prop->pspec->owner_type));
+  return (RsgAbstractNode*)node;
+}
+
+const RsgProperty* rsgNodeLookupProperty(RsgNode* node, const char* name) {
+  assert(RSG_IS_ABSTRACT_NODE(node) != false);
+  GParamSpec* pspec =
+      g_object_class_find_property(G_OBJECT_GET_CLASS(node), name);
+  if (pspec == NULL) {
+    g_warning("%s has no property '%s'", G_OBJECT_TYPE_NAME(node), name);
+    return NULL;
+  }
+  return intern(pspec);
+}
+
+GParamSpec* rsgPropertyGetPspec(const RsgProperty* prop) {
+  return prop->pspec;
+}
+
+RsgValueType rsgPropertyGetType(const RsgProperty* prop) {
+  return prop->type;
+}
+
+const char* rsgPropertyGetName(const RsgProperty* prop) {
+  return prop->pspec->name;
+}
+
+void rsgNodeSetPropertyValue(RsgNode* node,
+                             const RsgProperty* prop,
+                             RsgValue value) {
+  // numbers convert into each other, as they would through GValue
+  if (value.type == RSG_VALUE_INT && prop->type == RSG_VALUE_FLOAT)
+    value = rsgValueFloat((float)value.asInt);
+  else if (value.type == RSG_VALUE_FLOAT && prop->type == RSG_VALUE_INT)
+    value = rsgValueInt((int)value.asFloat);
+  setValue(checkedNode(node, prop, value.type), prop, &value.asPointer);
+}
+
+RsgValue rsgNodeGetPropertyValue(RsgNode* node, const RsgProperty* prop) {
+  RsgValue value = {.type = prop->type};
+  getValue(checkedNode(node, prop, prop->type), prop, &value.asPointer);
+  return value;
+}
+
+/*
+ * Typed accessors
+ */
+#define RSG_PROPERTY_ACCESSORS(suffix, ctype, valueType)                   \
+  void rsgNodeSetProperty##suffix(RsgNode* node, const RsgProperty* prop, \
+                                  ctype value) {                          \
+    setValue(checkedNode(node, prop, valueType), prop, &value);           \
+  }                                                                       \
+  ctype rsgNodeGetProperty##suffix(RsgNode* node,                         \
+                                   const RsgProperty* prop) {             \
+    ctype value;                                                          \
+    getValue(checkedNode(node, prop, valueType), prop, &value);           \
+    return value;                                                         \
+  }
+
+RSG_PROPERTY_ACCESSORS(Pointer, void*, RSG_VALUE_POINTER)
+RSG_PROPERTY_ACCESSORS(Int, int, RSG_VALUE_INT)
+RSG_PROPERTY_ACCESSORS(Float, float, RSG_VALUE_FLOAT)
+RSG_PROPERTY_ACCESSORS(Vec2, vec2s, RSG_VALUE_VEC2)
+RSG_PROPERTY_ACCESSORS(Vec3, vec3s, RSG_VALUE_VEC3)
+RSG_PROPERTY_ACCESSORS(Vec4, vec4s, RSG_VALUE_VEC4)
+RSG_PROPERTY_ACCESSORS(Mat4, mat4s, RSG_VALUE_MAT4)
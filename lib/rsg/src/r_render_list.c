@@ -0,0 +1,339 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "rsg_internal.h"
+
+/*
+ * Render list.
+ * Built by asking every node to emit its commands through compileFunc and
+ * replayed each frame instead of walking the graph through processFunc.
+ * A list is recompiled lazily on its next replay after being invalidated.
+ */
+
+RsgRenderList* rsgRenderListCreate(
+    RsgAbstractNode* owner,
+    void (*compileFunc)(RsgAbstractNode* owner, RsgRenderList* list),
+    bool saveLocal) {
+  RsgRenderList* list = rsgMalloc(sizeof(*list));
+  list->ops = NULL;
+  list->numOps = 0;
+  list->capacity = 0;
+  list->instanceOps = NULL;
+  list->numInstanceOps = 0;
+  list->instanceOpsCapacity = 0;
+  list->valid = false;
+  list->saveLocal = saveLocal;
+  list->owner = owner;
+  list->compileFunc = compileFunc;
+  return list;
+}
+
+void rsgRenderListDestroy(RsgRenderList* list) {
+  rsgFree(list->ops);
+  rsgFree(list->instanceOps);
+  rsgFree(list);
+}
+
+void rsgRenderListInvalidate(RsgRenderList* list) {
+  list->valid = false;
+}
+
+void rsgRenderListEmit(RsgRenderList* list, RsgOp op) {
+  if (list->numOps == list->capacity) {
+    list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+    list->ops = rsgRealloc(list->ops, list->capacity * sizeof(*list->ops));
+  }
+  list->ops[list->numOps++] = op;
+}
+
+static void appendInstanceOp(RsgRenderList* list, RsgOp op) {
+  if (list->numInstanceOps == list->instanceOpsCapacity) {
+    list->instanceOpsCapacity =
+        list->instanceOpsCapacity == 0 ? 16 : list->instanceOpsCapacity * 2;
+    list->instanceOps =
+        rsgRealloc(list->instanceOps,
+                   list->instanceOpsCapacity * sizeof(*list->instanceOps));
+  }
+  list->instanceOps[list->numInstanceOps++] = op;
+}
+
+/*
+ * Collapse runs of adjacent draws of the same geometry into instanced draws.
+ * Nothing can change the program or the uniforms between adjacent draws, so
+ * they only differ by their model matrix.
+ */
+static void mergeInstances(RsgRenderList* list) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < list->numOps) {
+    const RsgOp* op = &list->ops[in];
+    size_t run = in + 1;
+
+    if (op->code == RSG_OP_DRAW) {
+      while (run < list->numOps && list->ops[run].code == RSG_OP_DRAW &&
+             list->ops[run].draw == op->draw)
+        run++;
+    }
+    if (run - in < 2) {
+      list->ops[out++] = list->ops[in++];
+      continue;
+    }
+
+    RsgOp merged = {.code = RSG_OP_DRAW_INSTANCED,
+                    .node = op->node,
+                    .instances = {.first = list->numInstanceOps,
+                                  .count = run - in}};
+    for (; in < run; in++) appendInstanceOp(list, list->ops[in]);
+    list->ops[out++] = merged;
+  }
+  list->numOps = out;
+}
+
+static void compile(RsgRenderList* list) {
+  list->numOps = 0;
+  list->numInstanceOps = 0;
+  list->compileFunc(list->owner, list);
+  mergeInstances(list);
+  list->valid = true;
+}
+
+static void drawInstanced(const RsgRenderList* list,
+                          const RsgOp* op,
+                          RsgContext* ctx) {
+  const RsgOp* first = &list->instanceOps[op->instances.first];
+  const mat4s** models =
+      rsgArenaAlloc(ctx->frameArena, op->instances.count * sizeof(*models));
+  size_t numVisible = 0;
+  size_t i;
+  for (i = 0; i < op->instances.count; i++) {
+    const mat4s* world = rsgMeshNodeGetVisibleWorld(first[i].node, ctx);
+    if (world != NULL) models[numVisible++] = world;
+  }
+
+  if (numVisible == 1)
+    rsgDrawElements(ctx, first->draw, models[0]);
+  else if (numVisible > 1)
+    rsgDrawElementsInstanced(ctx, first->draw, models, numVisible);
+}
+
+/*
+ * The profiled replay is a separate instance of the same code, so the
+ * profiler costs nothing unless it is enabled.
+ */
+#define PROFILED(profile, node, call)     \
+  do {                                    \
+    if (profile) rsgProfilerEnter(node);  \
+    call;                                 \
+    if (profile) rsgProfilerLeave();      \
+  } while (0)
+
+static inline void replay(RsgRenderList* list,
+                          RsgContext* ctx,
+                          const bool profile) {
+  if (list->valid == false) compile(list);
+  if (list->numOps == 0) return;
+
+  RsgLocalContext* lctxBackup = NULL;
+  if (list->saveLocal) {
+    lctxBackup = rsgArenaAlloc(ctx->frameArena, sizeof(*lctxBackup));
+    *lctxBackup = *ctx->local;
+  }
+
+  const RsgOp* op = list->ops;
+  const RsgOp* end = list->ops + list->numOps;
+  for (; op != end; op++) {
+    switch (op->code) {
+      case RSG_OP_PROCESS:
+      case RSG_OP_UPDATE:
+        PROFILED(profile, op->node, op->processFunc(op->node, ctx));
+        break;
+      case RSG_OP_CALL:
+        if (rsgGroupNodeCull(op->node, ctx) == false) {
+          if (profile) {
+            rsgProfilerEnter(op->node);
+            rsgRenderListReplayProfiled(op->list, ctx);
+            rsgProfilerLeave();
+          } else {
+            rsgRenderListReplay(op->list, ctx);
+          }
+        }
+        break;
+      case RSG_OP_CLEAR:
+        rsgGlClearColor(ctx->gl, *op->color);
+        rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        break;
+      case RSG_OP_SET_PROGRAM:
+        ctx->local->program = op->program;
+        break;
+      case RSG_OP_SET_VIEW:
+        ctx->local->u_view = *op->matrix;
+        ctx->local->frustumValid = false;
+        break;
+      case RSG_OP_SET_PROJECTION:
+        ctx->local->u_projection = *op->matrix;
+        ctx->local->frustumValid = false;
+        break;
+      case RSG_OP_DRAW: {
+        const mat4s* world = rsgMeshNodeGetVisibleWorld(op->node, ctx);
+        if (world != NULL)
+          PROFILED(profile, op->node, rsgDrawElements(ctx, op->draw, world));
+        break;
+      }
+      case RSG_OP_DRAW_INSTANCED:
+        PROFILED(profile, op->node, drawInstanced(list, op, ctx));
+        break;
+    }
+  }
+
+  if (lctxBackup != NULL) *ctx->local = *lctxBackup;
+}
+
+void rsgRenderListReplay(RsgRenderList* list, RsgContext* ctx) {
+  replay(list, ctx, false);
+}
+
+void rsgRenderListReplayProfiled(RsgRenderList* list, RsgContext* ctx) {
+  replay(list, ctx, true);
+}
+
+/*
+ * Resolving into a frame packet: the replay above, minus the GL calls.
+ * Nodes that need the GL thread (RSG_OP_PROCESS) are recorded along with a
+ * snapshot of the local context; changes they make to it don't carry over
+ * to the entries after them.
+ */
+static RsgPacketEntry* addEntry(RsgPacket* packet,
+                                RsgPacketCode code,
+                                RsgContext* ctx) {
+  if (packet->numEntries == packet->capacity) {
+    packet->capacity = packet->capacity == 0 ? 64 : packet->capacity * 2;
+    packet->entries = rsgRealloc(packet->entries,
+                                 packet->capacity * sizeof(*packet->entries));
+  }
+  if (packet->snapshot == NULL) {
+    RsgLocalContext* snapshot =
+        rsgArenaAlloc(packet->arena, sizeof(*snapshot));
+    *snapshot = *ctx->local;
+    packet->snapshot = snapshot;
+  }
+
+  RsgPacketEntry* entry = &packet->entries[packet->numEntries++];
+  entry->code = code;
+  entry->local = packet->snapshot;
+  return entry;
+}
+
+static void addDraw(RsgPacket* packet,
+                    RsgContext* ctx,
+                    const RsgGeometry* geometry,
+                    const mat4s* const* worlds,
+                    size_t numInstances) {
+  const mat4s** models =
+      rsgArenaAlloc(packet->arena, numInstances * sizeof(*models));
+  mat4s* copies = rsgArenaAlloc(packet->arena, numInstances * sizeof(*copies));
+  size_t i;
+  for (i = 0; i < numInstances; i++) {
+    copies[i] = *worlds[i];
+    models[i] = &copies[i];
+  }
+
+  RsgPacketEntry* entry = addEntry(packet, RSG_PACKET_DRAW, ctx);
+  entry->draw.geometry = geometry;
+  entry->draw.models = models;
+  entry->draw.numInstances = numInstances;
+}
+
+void rsgRenderListResolve(RsgRenderList* list,
+                          RsgContext* ctx,
+                          RsgPacket* packet) {
+  if (list->valid == false) compile(list);
+  if (list->numOps == 0) return;
+
+  RsgLocalContext* lctxBackup = NULL;
+  if (list->saveLocal) {
+    lctxBackup = rsgArenaAlloc(ctx->frameArena, sizeof(*lctxBackup));
+    *lctxBackup = *ctx->local;
+  }
+
+  const RsgOp* op = list->ops;
+  const RsgOp* end = list->ops + list->numOps;
+  for (; op != end; op++) {
+    switch (op->code) {
+      case RSG_OP_PROCESS: {
+        RsgPacketEntry* entry = addEntry(packet, RSG_PACKET_PROCESS, ctx);
+        entry->process.node = op->node;
+        entry->process.processFunc = op->processFunc;
+        break;
+      }
+      case RSG_OP_UPDATE:
+        op->processFunc(op->node, ctx);
+        packet->snapshot = NULL;
+        break;
+      case RSG_OP_CALL:
+        if (rsgGroupNodeCull(op->node, ctx) == false)
+          rsgRenderListResolve(op->list, ctx, packet);
+        break;
+      case RSG_OP_CLEAR:
+        addEntry(packet, RSG_PACKET_CLEAR, ctx)->color = *op->color;
+        break;
+      case RSG_OP_SET_PROGRAM:
+        ctx->local->program = op->program;
+        packet->snapshot = NULL;
+        break;
+      case RSG_OP_SET_VIEW:
+        ctx->local->u_view = *op->matrix;
+        ctx->local->frustumValid = false;
+        packet->snapshot = NULL;
+        break;
+      case RSG_OP_SET_PROJECTION:
+        ctx->local->u_projection = *op->matrix;
+        ctx->local->frustumValid = false;
+        packet->snapshot = NULL;
+        break;
+      case RSG_OP_DRAW: {
+        const mat4s* world = rsgMeshNodeGetVisibleWorld(op->node, ctx);
+        if (world != NULL)
+          addDraw(packet, ctx, op->draw, &world, 1);
+        break;
+      }
+      case RSG_OP_DRAW_INSTANCED: {
+        const RsgOp* first = &list->instanceOps[op->instances.first];
+        const mat4s** worlds = rsgArenaAlloc(
+            ctx->frameArena, op->instances.count * sizeof(*worlds));
+        size_t numVisible = 0;
+        size_t i;
+        for (i = 0; i < op->instances.count; i++) {
+          const mat4s* world = rsgMeshNodeGetVisibleWorld(first[i].node, ctx);
+          if (world != NULL) worlds[numVisible++] = world;
+        }
+        if (numVisible > 0)
+          addDraw(packet, ctx, first->draw, worlds, numVisible);
+        break;
+      }
+    }
+  }
+
+  if (lctxBackup != NULL) {
+    *ctx->local = *lctxBackup;
+    packet->snapshot = NULL;
+  }
+}
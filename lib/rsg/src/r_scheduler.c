@@ -0,0 +1,85 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Frame scheduler for immediate mode.
+ * Frames start at absolute deadlines on the monotonic clock, one period
+ * apart, so the time spent on a frame is accounted for instead of being
+ * added to a fixed sleep. The scheduler sleeps until shortly before the
+ * deadline and optionally busy-waits the rest, as sleeps tend to overshoot
+ * by some tens of microseconds.
+ *
+ * A frame that ends past the next deadline counts as missed; the schedule
+ * then skips the deadlines already gone rather than trying to catch up.
+ */
+
+#define NSEC_PER_SEC 1000000000LL
+
+static long long spinNs = 0;
+
+static long long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleepUntil(long long deadline) {
+  struct timespec ts = {.tv_sec = deadline / NSEC_PER_SEC,
+                        .tv_nsec = deadline % NSEC_PER_SEC};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    ;  // interrupted by a signal
+}
+
+void rsgSchedulerStart(RsgScheduler* scheduler, int frequency) {
+  assert(frequency > 0);
+  scheduler->periodNs = NSEC_PER_SEC / frequency;
+  scheduler->deadline = now() + scheduler->periodNs;
+  scheduler->frames = 0;
+  scheduler->missed = 0;
+}
+
+void rsgSchedulerWait(RsgScheduler* scheduler) {
+  long long t = now();
+  scheduler->frames++;
+
+  if (t >= scheduler->deadline) {
+    scheduler->missed++;
+    long long skipped = (t - scheduler->deadline) / scheduler->periodNs + 1;
+    scheduler->deadline += skipped * scheduler->periodNs;
+    return;
+  }
+
+  if (scheduler->deadline - t > spinNs)
+    sleepUntil(scheduler->deadline - spinNs);
+  while (now() < scheduler->deadline)
+    ;  // spin
+  scheduler->deadline += scheduler->periodNs;
+}
+
+void rsgSetFrameSpin(int usec) {
+  assert(usec >= 0);
+  spinNs = usec * 1000LL;
+}
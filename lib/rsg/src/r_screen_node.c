@@ -48,9 +48,15 @@ static GParamSpec* properties[N_PROPERTIES] = {NULL};
 static void process(RsgAbstractNode* node, RsgContext* ctx) {
   RsgScreenNode* cnode = RSG_SCREEN_NODE(node);
 
-  glClearColor(cnode->clearColor.raw[0], cnode->clearColor.raw[1],
-               cnode->clearColor.raw[2], cnode->clearColor.raw[3]);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  rsgGlClearColor(ctx->gl, cnode->clearColor);
+  rsgGl->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgScreenNode* cnode = RSG_SCREEN_NODE(node);
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_CLEAR,
+                                  .node = node,
+                                  .color = &cnode->clearColor});
 }
 
 static void set_property(GObject* object,
@@ -99,8 +105,15 @@ static void get_property(GObject* object,
   }
 }
 
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  // clears the whole screen: never cull it away
+  return false;
+}
+
 static void rsg_screen_node_class_init(RsgScreenNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
 
   G_OBJECT_CLASS(klass)->set_property = set_property;
   G_OBJECT_CLASS(klass)->get_property = get_property;
@@ -121,6 +134,10 @@ static void rsg_screen_node_class_init(RsgScreenNodeClass* klass) {
 
   g_object_class_install_properties(G_OBJECT_CLASS(klass), N_PROPERTIES,
                                     properties);
+
+  // plain storage for the handle-based accessors
+  rsgPropertySetStorage(properties[PROP_CLEAR_COLOR],
+                        G_STRUCT_OFFSET(RsgScreenNode, clearColor), NULL);
 }
 
 static void rsg_screen_node_init(RsgScreenNode* cnode) {
@@ -49,67 +49,144 @@ static char* file_get_contents(FILE* fp) {
 static int program_add_shader(GLuint program,
                               GLenum shader_type,
                               const char* shader_src) {
-  GLuint shader = glCreateShader(shader_type);
+  GLuint shader = rsgGl->CreateShader(shader_type);
   const GLchar* source[1] = {shader_src};
   const GLint length[1] = {(GLint)strlen(shader_src)};
 
-  glShaderSource(shader, 1, source, length);
-  glCompileShader(shader);
+  rsgGl->ShaderSource(shader, 1, source, length);
+  rsgGl->CompileShader(shader);
 
   GLint param_val;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &param_val);
+  rsgGl->GetShaderiv(shader, GL_COMPILE_STATUS, &param_val);
   if (param_val != GL_TRUE) {
     // fetch and print the info log
-    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &param_val);
+    rsgGl->GetShaderiv(shader, GL_INFO_LOG_LENGTH, &param_val);
     GLchar* buffer = rsgMalloc((size_t)param_val);
-    glGetShaderInfoLog(shader, param_val, NULL, buffer);
-    glDeleteShader(shader);
+    rsgGl->GetShaderInfoLog(shader, param_val, NULL, buffer);
+    rsgGl->DeleteShader(shader);
     printf("Shader type %d compile error: %s\n", shader_type, buffer);
     rsgFree(buffer);
     return -1;
   }
-  glAttachShader(program, shader);
-  glDeleteShader(shader);  // marks the shader for deletion upon deletion of the
-                           // program object
+  rsgGl->AttachShader(program, shader);
+  // marks the shader for deletion upon deletion of the program object
+  rsgGl->DeleteShader(shader);
   return 0;
 }
 
+/*
+ * Reflected programs, by GL program name. An entry lives as long as its
+ * program: rsgShaderProgramDelete() drops both, so that a later program
+ * given the same name is reflected anew.
+ */
+static GHashTable* programs = NULL;
+
+static void program_free(gpointer data) {
+  RsgShaderProgram* info = data;
+  size_t i;
+  for (i = 0; i < info->numUniforms; i++) rsgFree(info->uniforms[i].name);
+  rsgFree(info->uniforms);
+  rsgFree(info);
+}
+
+static const char* slotNames[RSG_UNIFORM_NUM_SLOTS] = {
+    [RSG_UNIFORM_MODEL] = "u_model",
+    [RSG_UNIFORM_VIEW] = "u_view",
+    [RSG_UNIFORM_PROJECTION] = "u_projection",
+};
+
+static RsgShaderProgram* program_reflect(GLuint program) {
+  RsgShaderProgram* info = rsgMalloc(sizeof(*info));
+  GLint numUniforms = 0;
+  GLint maxNameLength = 0;
+  GLint i;
+  int slot;
+
+  info->handle = program;
+  for (slot = 0; slot < RSG_UNIFORM_NUM_SLOTS; slot++)
+    info->uniformSlots[slot] = -1;
+
+  rsgGl->GetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+  rsgGl->GetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+  info->numUniforms = (size_t)numUniforms;
+  info->uniforms = rsgCalloc(info->numUniforms, sizeof(*info->uniforms));
+
+  for (i = 0; i < numUniforms; i++) {
+    RsgUniformInfo* uniform = &info->uniforms[i];
+    uniform->name = rsgMalloc((size_t)maxNameLength + 1);
+    rsgGl->GetActiveUniform(program, (GLuint)i, maxNameLength + 1, NULL,
+                            &uniform->size, &uniform->type, uniform->name);
+    // arrays are reported as their first element, "name[0]"
+    if (g_str_has_suffix(uniform->name, "[0]"))
+      uniform->name[strlen(uniform->name) - 3] = '\0';
+    uniform->location = rsgGl->GetUniformLocation(program, uniform->name);
+
+    for (slot = 0; slot < RSG_UNIFORM_NUM_SLOTS; slot++) {
+      if (strcmp(uniform->name, slotNames[slot]) == 0)
+        info->uniformSlots[slot] = uniform->location;
+    }
+  }
+
+  info->instanceModelAttrib = rsgGl->GetAttribLocation(program, "a_model");
+  if (info->instanceModelAttrib != -1 &&
+      info->instanceModelAttrib <= RSG_ATTRIB_TEXCOORD) {
+    // instance arrays there would replace the mesh arrays of the shared VAOs
+    g_warning("Program %u has \"a_model\" at location %d, over the mesh "
+              "attributes; its meshes are drawn one by one",
+              program, info->instanceModelAttrib);
+    info->instanceModelAttrib = -1;
+  }
+
+  if (programs == NULL)
+    programs = g_hash_table_new_full(g_direct_hash, NULL, NULL, program_free);
+  g_hash_table_insert(programs, GUINT_TO_POINTER(program), info);
+
+  return info;
+}
+
 static GLuint program_create(const char* vertex_src, const char* fragment_src) {
   GLuint program;
-  program = glCreateProgram();
+  program = rsgGl->CreateProgram();
 
   if (program_add_shader(program, GL_VERTEX_SHADER, vertex_src) != 0) {
-    glDeleteProgram(program);
+    rsgGl->DeleteProgram(program);
     return 0;
   }
   if (program_add_shader(program, GL_FRAGMENT_SHADER, fragment_src) != 0) {
-    glDeleteProgram(program);
+    rsgGl->DeleteProgram(program);
     return 0;
   }
   GLint param_val;
-  glLinkProgram(program);
-  glGetProgramiv(program, GL_LINK_STATUS, &param_val);
+  // explicit layout qualifiers in the sources take precedence over these
+  rsgGl->BindAttribLocation(program, RSG_ATTRIB_POSITION, "a_position");
+  rsgGl->BindAttribLocation(program, RSG_ATTRIB_NORMAL, "a_normal");
+  rsgGl->BindAttribLocation(program, RSG_ATTRIB_TEXCOORD, "a_texcoord");
+  rsgGl->BindAttribLocation(program, RSG_ATTRIB_MODEL, "a_model");
+  rsgGl->LinkProgram(program);
+  rsgGl->GetProgramiv(program, GL_LINK_STATUS, &param_val);
   if (param_val != GL_TRUE) {
-    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &param_val);
+    rsgGl->GetProgramiv(program, GL_INFO_LOG_LENGTH, &param_val);
     GLchar* buffer = rsgMalloc((size_t)param_val);
-    glGetProgramInfoLog(program, param_val, NULL, buffer);
-    glDeleteProgram(program);
+    rsgGl->GetProgramInfoLog(program, param_val, NULL, buffer);
+    rsgGl->DeleteProgram(program);
     printf("Program link error: %s\n", buffer);
     rsgFree(buffer);
     return 0;
   }
-  glValidateProgram(program);
-  glGetProgramiv(program, GL_VALIDATE_STATUS, &param_val);
+  rsgGl->ValidateProgram(program);
+  rsgGl->GetProgramiv(program, GL_VALIDATE_STATUS, &param_val);
   if (param_val != GL_TRUE) {
-    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &param_val);
+    rsgGl->GetProgramiv(program, GL_INFO_LOG_LENGTH, &param_val);
     GLchar* buffer = rsgMalloc((size_t)param_val);
-    glGetProgramInfoLog(program, param_val, NULL, buffer);
-    glDeleteProgram(program);
+    rsgGl->GetProgramInfoLog(program, param_val, NULL, buffer);
+    rsgGl->DeleteProgram(program);
     printf("Program validation error: %s\n", buffer);
     rsgFree(buffer);
     return 0;
   }
 
+  (void)program_reflect(program);
+
   return program;
 }
 
@@ -144,3 +221,33 @@ GLuint rsgShaderProgramAssembleFromFiles(const char* vertexPath,
 
   return program;
 }
+
+const RsgShaderProgram* rsgShaderProgramGet(GLuint program) {
+  if (program == 0) return NULL;
+
+  RsgShaderProgram* info = NULL;
+  if (programs != NULL)
+    info = g_hash_table_lookup(programs, GUINT_TO_POINTER(program));
+  if (info == NULL) {
+    // linked outside of RSG
+    info = program_reflect(program);
+  }
+  return info;
+}
+
+void rsgShaderProgramDelete(unsigned int program) {
+  if (program == 0) return;
+  if (programs != NULL)
+    g_hash_table_remove(programs, GUINT_TO_POINTER(program));
+  rsgGl->DeleteProgram(program);
+}
+
+GLint rsgShaderProgramGetUniformLocation(const RsgShaderProgram* program,
+                                         const char* name) {
+  size_t i;
+  for (i = 0; i < program->numUniforms; i++) {
+    if (strcmp(program->uniforms[i].name, name) == 0)
+      return program->uniforms[i].location;
+  }
+  return -1;
+}
@@ -24,7 +24,8 @@
 
 /*
  * Shader node.
- * Creates OpenGL shader program object from sources in memory or files.
+ * Creates OpenGL shader program object from sources in memory or files, and
+ * deletes it with the node; a program given by name stays the caller's.
  *
  * On process: sets active shader program in the local context.
  *
@@ -39,7 +40,8 @@ G_DECLARE_FINAL_TYPE(RsgShaderNode,
 
 struct _RsgShaderNode {
   RsgAbstractNode abstract;
-  GLuint program;
+  const RsgShaderProgram* program;
+  bool ownsProgram;  // built from sources: deleted with the node
 };
 
 G_DEFINE_TYPE(RsgShaderNode, rsg_shader_node, RSG_TYPE_ABSTRACT_NODE)
@@ -53,8 +55,23 @@ static void process(RsgAbstractNode* node, RsgContext* ctx) {
   ctx->local->program = cnode->program;
 }
 
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  RsgShaderNode* cnode = RSG_SHADER_NODE(node);
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_SET_PROGRAM,
+                                  .node = node,
+                                  .program = cnode->program});
+}
+
+static void finalize(GObject* node) {
+  RsgShaderNode* cnode = RSG_SHADER_NODE(node);
+  if (cnode->ownsProgram) rsgShaderProgramDelete(cnode->program->handle);
+  G_OBJECT_CLASS(rsg_shader_node_parent_class)->finalize(node);
+}
+
 static void rsg_shader_node_class_init(RsgShaderNodeClass* klass) {
   RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  G_OBJECT_CLASS(klass)->finalize = finalize;
 }
 
 static void rsg_shader_node_init(RsgShaderNode* cnode) {}
@@ -62,7 +79,7 @@ static void rsg_shader_node_init(RsgShaderNode* cnode) {}
 RsgNode* rsgShaderNodeCreate(unsigned int program) {
   RsgNode* node = g_object_new(rsg_shader_node_get_type(), NULL);
 
-  RSG_SHADER_NODE(node)->program = program;
+  RSG_SHADER_NODE(node)->program = rsgShaderProgramGet(program);
   return node;
 }
 
@@ -71,12 +88,16 @@ RsgNode* rsgShaderNodeCreateFromMemory(const char* vertexText,
   GLuint program =
       rsgShaderProgramAssembleFromStrings(vertexText, fragmentText);
   assert(program != 0);
-  return rsgShaderNodeCreate(program);
+  RsgNode* node = rsgShaderNodeCreate(program);
+  RSG_SHADER_NODE(node)->ownsProgram = true;
+  return node;
 }
 
 RsgNode* rsgShaderNodeCreateFromFiles(const char* vertexPath,
                                       const char* fragmentPath) {
   GLuint program = rsgShaderProgramAssembleFromFiles(vertexPath, fragmentPath);
   assert(program != 0);
-  return rsgShaderNodeCreate(program);
+  RsgNode* node = rsgShaderNodeCreate(program);
+  RSG_SHADER_NODE(node)->ownsProgram = true;
+  return node;
 }
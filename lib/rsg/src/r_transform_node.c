@@ -0,0 +1,170 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "rsg_internal.h"
+
+/*
+ * Transform node.
+ * When processed:
+ * multiplies its matrix into "u_model" in the local context.
+ *
+ * The resulting world matrix is cached and only recomputed when the matrix
+ * of the node or the incoming "u_model" changes. The local context carries a
+ * generation number along with "u_model" that identifies its value, so a
+ * static hierarchy costs a comparison per transform instead of a matrix
+ * product.
+ *
+ * Properties:
+ * - "matrix" of mat4s
+ */
+
+G_DECLARE_FINAL_TYPE(RsgTransformNode,
+                     rsg_transform_node,
+                     RSG,
+                     TRANSFORM_NODE,
+                     RsgAbstractNode)
+
+struct _RsgTransformNode {
+  RsgAbstractNode abstract;
+  mat4s matrix;
+  bool matrixChanged;
+
+  // world matrix cache
+  mat4s world;
+  size_t worldGeneration;
+  size_t parentGeneration;  // of the "u_model" the cache was computed from
+};
+
+G_DEFINE_TYPE(RsgTransformNode, rsg_transform_node, RSG_TYPE_ABSTRACT_NODE)
+
+enum { PROP_MATRIX = 1, N_PROPERTIES };
+
+static GParamSpec* properties[N_PROPERTIES] = {NULL};
+
+/*
+ * Source of world matrix generations; 0 stands for the identity. Advanced
+ * atomically, as the update phase may run on several threads
+ */
+static gsize lastGeneration = 0;
+
+static void process(RsgAbstractNode* node, RsgContext* ctx) {
+  RsgTransformNode* cnode = RSG_TRANSFORM_NODE(node);
+
+  if (cnode->matrixChanged ||
+      cnode->parentGeneration != ctx->local->modelGeneration) {
+    if (ctx->local->modelGeneration == 0)
+      cnode->world = cnode->matrix;
+    else
+      cnode->world = glms_mat4_mul(ctx->local->u_model, cnode->matrix);
+    cnode->parentGeneration = ctx->local->modelGeneration;
+    cnode->worldGeneration = g_atomic_pointer_add(&lastGeneration, 1) + 1;
+    cnode->matrixChanged = false;
+  }
+
+  /*
+   * Write to the local context
+   */
+  ctx->local->u_model = cnode->world;
+  ctx->local->modelGeneration = cnode->worldGeneration;
+}
+
+static void compile(RsgAbstractNode* node, RsgRenderList* list) {
+  rsgRenderListEmit(list, (RsgOp){.code = RSG_OP_UPDATE,
+                                  .node = node,
+                                  .processFunc = process});
+}
+
+static bool bounds(RsgAbstractNode* node, mat4s* model, vec3s box[2]) {
+  *model = glms_mat4_mul(*model, RSG_TRANSFORM_NODE(node)->matrix);
+  return true;
+}
+
+static void set_property(GObject* object,
+                         guint property_id,
+                         const GValue* value,
+                         GParamSpec* pspec) {
+  RsgTransformNode* cnode = RSG_TRANSFORM_NODE(object);
+
+  switch (property_id) {
+    case PROP_MATRIX:
+      cnode->matrix = *(mat4s*)g_value_get_boxed(value);
+      cnode->matrixChanged = true;
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+      break;
+  }
+}
+
+static void get_property(GObject* object,
+                         guint property_id,
+                         GValue* value,
+                         GParamSpec* pspec) {
+  RsgTransformNode* cnode = RSG_TRANSFORM_NODE(object);
+
+  switch (property_id) {
+    case PROP_MATRIX:
+      g_value_set_boxed(value, &cnode->matrix);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+      break;
+  }
+}
+
+static void changed(RsgAbstractNode* node) {
+  RSG_TRANSFORM_NODE(node)->matrixChanged = true;
+}
+
+static void rsg_transform_node_class_init(RsgTransformNodeClass* klass) {
+  RSG_ABSTRACT_NODE_CLASS(klass)->processFunc = process;
+  // replayed through processFunc, as the world matrix depends on the
+  // incoming "u_model"; but no GL is involved
+  RSG_ABSTRACT_NODE_CLASS(klass)->compileFunc = compile;
+  RSG_ABSTRACT_NODE_CLASS(klass)->boundsFunc = bounds;
+  RSG_ABSTRACT_NODE_CLASS(klass)->updateFunc = process;  // CPU only
+
+  G_OBJECT_CLASS(klass)->set_property = set_property;
+  G_OBJECT_CLASS(klass)->get_property = get_property;
+
+  properties[PROP_MATRIX] =
+      g_param_spec_boxed("matrix", "Matrix", "Local transformation matrix",
+                         mat4s_get_type(), G_PARAM_READWRITE);
+
+  g_object_class_install_properties(G_OBJECT_CLASS(klass), N_PROPERTIES,
+                                    properties);
+
+  // plain storage for the handle-based accessors
+  rsgPropertySetStorage(properties[PROP_MATRIX],
+                        G_STRUCT_OFFSET(RsgTransformNode, matrix), changed);
+}
+
+static void rsg_transform_node_init(RsgTransformNode* cnode) {
+  cnode->matrix = glms_mat4_identity();
+  cnode->matrixChanged = true;
+}
+
+RsgNode* rsgTransformNodeCreate(mat4s matrix) {
+  RsgNode* node = g_object_new(rsg_transform_node_get_type(), NULL);
+  RSG_TRANSFORM_NODE(node)->matrix = matrix;
+  return node;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "rsg_internal.h"
+
+/*
+ * Update phase.
+ * Before the GL thread replays the render lists, the CPU side of the frame
+ * (world matrices of transforms and meshes, bounds of groups) is computed
+ * by the updateFunc of the nodes, walking the scene like the replay does.
+ * The replay then finds those caches valid and only submits.
+ *
+ * Subtrees of child groups are handed to a pool of worker threads while
+ * the pool has spare capacity, and walked in place otherwise. Only nodes
+ * with a single parent are updated off the GL thread; a group stops at its
+ * first shared child and leaves the rest to the replay, so no two workers
+ * ever touch the same node.
+ *
+ * Outside of the update phase, the pool also runs batches of independent
+ * jobs for rsgUpdateParallelFor() (e.g. parsing chunks of a mesh file).
+ */
+
+typedef struct {
+  size_t pending;  // under the lock: the batch lives on the waiter's stack
+  GMutex lock;
+  GCond cond;
+} RsgJobBatch;
+
+typedef struct {
+  RsgAbstractNode* node;  // NULL for a job of a batch
+  RsgLocalContext local;  // incoming, owned by the task
+  void (*func)(void* item);
+  void* item;
+  RsgJobBatch* batch;
+} RsgUpdateTask;
+
+static GThreadPool* pool = NULL;
+static int numThreads = -1;  // -1 until configured: one per spare core
+
+static gint pendingTasks = 0;
+static GMutex doneLock;
+static GCond doneCond;
+
+static void taskDone(void) {
+  if (g_atomic_int_dec_and_test(&pendingTasks)) {
+    g_mutex_lock(&doneLock);
+    g_cond_signal(&doneCond);
+    g_mutex_unlock(&doneLock);
+  }
+}
+
+static void jobDone(RsgJobBatch* batch) {
+  g_mutex_lock(&batch->lock);
+  if (--batch->pending == 0) g_cond_signal(&batch->cond);
+  g_mutex_unlock(&batch->lock);
+}
+
+static void runTask(gpointer data, gpointer userData) {
+  RsgUpdateTask* task = data;
+  if (task->node == NULL) {
+    task->func(task->item);
+    jobDone(task->batch);
+    rsgFree(task);
+    return;
+  }
+
+  RsgContext ctx = {
+      .global = NULL, .local = &task->local, .frameArena = NULL, .gl = NULL};
+  RSG_ABSTRACT_NODE_GET_CLASS(task->node)->updateFunc(task->node, &ctx);
+  rsgFree(task);
+  taskDone();
+}
+
+void rsgSetUpdateThreads(int threads) {
+  assert(threads >= 0);
+  if (pool != NULL) {
+    g_thread_pool_free(pool, FALSE, TRUE);
+    pool = NULL;
+  }
+  numThreads = threads;
+  if (numThreads > 0)
+    pool = g_thread_pool_new(runTask, NULL, numThreads, TRUE, NULL);
+}
+
+bool rsgUpdateSpawn(RsgAbstractNode* node, const RsgLocalContext* local) {
+  // keep a few tasks queued per worker, so idle workers find some
+  if (pool == NULL || g_thread_pool_unprocessed(pool) >= 2 * (guint)numThreads)
+    return false;
+
+  RsgUpdateTask* task = rsgMalloc(sizeof(*task));
+  task->node = node;
+  task->local = *local;
+  task->func = NULL;
+  task->item = NULL;
+  task->batch = NULL;
+  g_atomic_int_inc(&pendingTasks);
+  g_thread_pool_push(pool, task, NULL);
+  return true;
+}
+
+void rsgUpdateRun(RsgAbstractNode* root) {
+  void (*updateFunc)(RsgAbstractNode*, RsgContext*) =
+      RSG_ABSTRACT_NODE_GET_CLASS(root)->updateFunc;
+
+  if (numThreads == -1) rsgSetUpdateThreads(g_get_num_processors() - 1);
+  // without workers the replay does the same work as it goes
+  if (pool == NULL || updateFunc == NULL) return;
+
+  RsgLocalContext local;
+  rsgLocalContextReset(&local);
+  RsgContext ctx = {
+      .global = NULL, .local = &local, .frameArena = NULL, .gl = NULL};
+
+  // the root is walked on this thread, counting as one task
+  g_atomic_int_set(&pendingTasks, 1);
+  updateFunc(root, &ctx);
+  taskDone();
+
+  g_mutex_lock(&doneLock);
+  while (g_atomic_int_get(&pendingTasks) > 0)
+    g_cond_wait(&doneCond, &doneLock);
+  g_mutex_unlock(&doneLock);
+}
+
+void rsgUpdateParallelFor(void (*func)(void* item),
+                          void* items,
+                          size_t itemSize,
+                          size_t numItems) {
+  size_t i;
+  if (numThreads == -1) rsgSetUpdateThreads(g_get_num_processors() - 1);
+  if (pool == NULL || numItems < 2) {
+    for (i = 0; i < numItems; i++) func((char*)items + i * itemSize);
+    return;
+  }
+
+  // has its own counter: may run while a pipelined update is in progress
+  RsgJobBatch batch;
+  g_mutex_init(&batch.lock);
+  g_cond_init(&batch.cond);
+  batch.pending = numItems;
+  for (i = 1; i < numItems; i++) {
+    RsgUpdateTask* task = rsgMalloc(sizeof(*task));
+    task->node = NULL;
+    task->func = func;
+    task->item = (char*)items + i * itemSize;
+    task->batch = &batch;
+    g_thread_pool_push(pool, task, NULL);
+  }
+
+  // the first item is done on this thread
+  func(items);
+  jobDone(&batch);
+
+  g_mutex_lock(&batch.lock);
+  while (batch.pending > 0) g_cond_wait(&batch.cond, &batch.lock);
+  g_mutex_unlock(&batch.lock);
+  g_mutex_clear(&batch.lock);
+  g_cond_clear(&batch.cond);
+}
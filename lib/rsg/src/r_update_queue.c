@@ -0,0 +1,182 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+
+#include "rsg_internal.h"
+
+/*
+ * Cross-thread property updates.
+ * Any thread may post (node, property, value) updates; they are pushed onto
+ * a lock-free stack (a compare-and-swap on its head) and never wait for the
+ * render thread. At the top of each frame the main loop detaches the whole
+ * stack at once, restores the posting order and applies the updates, so
+ * every batch lands within a single frame.
+ *
+ * Update records come from per-thread sources rather than the tracked
+ * allocator, whose heap locks the render thread would contend for when
+ * freeing them. The posting thread takes records off its own free list; the
+ * render thread gives applied ones back through the source's returned stack,
+ * which the owner takes over whole once its list runs dry. Only the first
+ * post of a thread, or one that outgrows its records, calls malloc(). A
+ * source is freed when its thread has exited and all of its records are
+ * back.
+ *
+ * Posting to an empty queue wakes up a main loop that waits for events.
+ */
+
+typedef struct RsgUpdate RsgUpdate;
+typedef struct RsgUpdateSource RsgUpdateSource;
+
+struct RsgUpdate {
+  RsgUpdate* next;
+  RsgUpdateSource* source;
+  RsgNode* node;  // referenced until applied
+  const RsgProperty* prop;
+  RsgValue value;
+};
+
+struct RsgUpdateSource {
+  RsgUpdate* free;      // the owner thread's
+  RsgUpdate* returned;  // pushed by the render thread, taken by the owner
+  gint refCount;        // the owner thread, and each record out
+};
+
+static RsgUpdate* head = NULL;  // newest first
+
+static pthread_key_t sourceKey;
+static pthread_once_t sourceKeyOnce = PTHREAD_ONCE_INIT;
+static __thread RsgUpdateSource* localSource = NULL;
+
+static RsgUpdate* takeAll(RsgUpdate** stack) {
+  RsgUpdate* updates;
+  do {
+    updates = g_atomic_pointer_get(stack);
+    if (updates == NULL) return NULL;
+  } while (g_atomic_pointer_compare_and_exchange(stack, updates, NULL) ==
+           false);
+  return updates;
+}
+
+static void freeUpdates(RsgUpdate* update) {
+  while (update != NULL) {
+    RsgUpdate* next = update->next;
+    g_free(update);
+    update = next;
+  }
+}
+
+static void sourceUnref(RsgUpdateSource* source) {
+  if (g_atomic_int_dec_and_test(&source->refCount) == false) return;
+  freeUpdates(source->free);
+  freeUpdates(source->returned);
+  g_free(source);
+}
+
+static void sourceThreadExit(void* arg) {
+  RsgUpdateSource* source = arg;
+  freeUpdates(source->free);
+  source->free = NULL;
+  sourceUnref(source);
+}
+
+static void sourceKeyCreate(void) {
+  pthread_key_create(&sourceKey, sourceThreadExit);
+}
+
+static RsgUpdate* updateTake(void) {
+  RsgUpdateSource* source = localSource;
+  if (source == NULL) {
+    pthread_once(&sourceKeyOnce, sourceKeyCreate);
+    source = g_new0(RsgUpdateSource, 1);
+    source->refCount = 1;
+    pthread_setspecific(sourceKey, source);
+    localSource = source;
+  }
+
+  if (source->free == NULL) source->free = takeAll(&source->returned);
+  RsgUpdate* update = source->free;
+  if (update != NULL) {
+    source->free = update->next;
+  } else {
+    update = g_new(RsgUpdate, 1);
+    update->source = source;
+  }
+  g_atomic_int_inc(&source->refCount);
+  return update;
+}
+
+// render thread
+static void updateGiveBack(RsgUpdate* update) {
+  RsgUpdateSource* source = update->source;
+  RsgUpdate* oldHead;
+  do {
+    oldHead = g_atomic_pointer_get(&source->returned);
+    update->next = oldHead;
+  } while (g_atomic_pointer_compare_and_exchange(&source->returned, oldHead,
+                                                 update) == false);
+  sourceUnref(source);
+}
+
+void rsgNodePostPropertyValue(RsgNode* node,
+                              const RsgProperty* prop,
+                              RsgValue value) {
+  assert(RSG_IS_ABSTRACT_NODE(node) != false);
+  assert(prop != NULL);
+
+  RsgUpdate* update = updateTake();
+  update->node = g_object_ref(node);
+  update->prop = prop;
+  update->value = value;
+
+  RsgUpdate* oldHead;
+  do {
+    oldHead = g_atomic_pointer_get(&head);
+    update->next = oldHead;
+  } while (g_atomic_pointer_compare_and_exchange(&head, oldHead, update) ==
+           false);
+
+  if (oldHead == NULL && rsgGetGlobalContext()->window != NULL)
+    glfwPostEmptyEvent();
+}
+
+void rsgUpdateQueueApply(void) {
+  RsgUpdate* batch = takeAll(&head);
+  if (batch == NULL) return;
+
+  // restore the posting order, so later updates win
+  RsgUpdate* ordered = NULL;
+  while (batch != NULL) {
+    RsgUpdate* next = batch->next;
+    batch->next = ordered;
+    ordered = batch;
+    batch = next;
+  }
+
+  while (ordered != NULL) {
+    RsgUpdate* next = ordered->next;
+    rsgNodeSetPropertyValue(ordered->node, ordered->prop, ordered->value);
+    g_object_unref(ordered->node);
+    updateGiveBack(ordered);
+    ordered = next;
+  }
+}
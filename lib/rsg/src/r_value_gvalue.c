@@ -79,7 +79,7 @@ GValue rsgValueToGValue(RsgValue value) {
   }
   if (value.type == RSG_VALUE_FLOAT) {
     g_value_init(&gvalue, G_TYPE_FLOAT);
-    g_value_set_int(&gvalue, value.asFloat);
+    g_value_set_float(&gvalue, value.asFloat);
     return gvalue;
   }
   if (value.type == RSG_VALUE_VEC2) {
@@ -26,6 +26,10 @@
 #include <glib-object.h>
 #include <rsg/rsg.h>
 
+/*
+ * rsgRealloc() and rsgFree() take only what these allocated (or NULL): they
+ * read a header in front of the pointer. Debug mode tells others apart.
+ */
 #define rsgMalloc(x) rsgMallocDbg(x, __FILE__, __LINE__)
 #define rsgCalloc(x, y) rsgCallocDbg(x, y, __FILE__, __LINE__)
 #define rsgRealloc(x, y) rsgReallocDbg(x, y, __FILE__, __LINE__)
@@ -34,24 +38,282 @@
 /*******************************************************************************
  * DATA.
  */
+/*
+ * Well-known uniforms whose locations are resolved at link time
+ */
+typedef enum {
+  RSG_UNIFORM_MODEL,
+  RSG_UNIFORM_VIEW,
+  RSG_UNIFORM_PROJECTION,
+  RSG_UNIFORM_NUM_SLOTS
+} RsgUniformSlot;
+
 typedef struct {
-  GLuint program;
+  char* name;
+  GLenum type;
+  GLint size;
+  GLint location;
+} RsgUniformInfo;
+
+/*
+ * Linked program together with its reflected active uniforms
+ */
+typedef struct {
+  GLuint handle;
+  size_t numUniforms;
+  RsgUniformInfo* uniforms;
+  GLint uniformSlots[RSG_UNIFORM_NUM_SLOTS];  // -1 if not active
+  GLint instanceModelAttrib;  // "a_model" per-instance mat4, -1 if not active
+} RsgShaderProgram;
+
+typedef struct {
+  const RsgShaderProgram* program;
+  mat4s u_model;
+  size_t modelGeneration;  // identifies the value of u_model; 0 if identity
   mat4s u_view;
   mat4s u_projection;
+  vec4s frustum[6];  // planes from u_projection * u_view, if frustumValid
+  bool frustumValid;
 } RsgLocalContext;
 
+typedef struct RsgArenaBlock RsgArenaBlock;
+
+typedef struct {
+  char* base;
+  size_t size;
+  size_t used;
+  RsgArenaBlock* overflow;
+  size_t overflowUsed;
+  size_t highWater;
+} RsgArena;
+
+/*
+ * GL dispatch table: the library makes every GL call through rsgGl, which
+ * points at the real, the null or the recording backend.
+ * X(return type, name without the gl prefix, parameters, arguments)
+ */
+#define RSG_GL_FUNCTIONS(X)                                                   \
+  X(void, ActiveTexture, (GLenum texture), (texture))                         \
+  X(void, AttachShader, (GLuint program, GLuint shader), (program, shader))   \
+  X(void, BindAttribLocation,                                                 \
+    (GLuint program, GLuint index, const GLchar* name),                       \
+    (program, index, name))                                                   \
+  X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer))       \
+  X(void, BindFramebuffer, (GLenum target, GLuint framebuffer),               \
+    (target, framebuffer))                                                    \
+  X(void, BindRenderbuffer, (GLenum target, GLuint renderbuffer),             \
+    (target, renderbuffer))                                                   \
+  X(void, BindTexture, (GLenum target, GLuint texture), (target, texture))    \
+  X(void, BindVertexArray, (GLuint array), (array))                           \
+  X(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor))    \
+  X(void, BufferData,                                                         \
+    (GLenum target, GLsizeiptr size, const void* data, GLenum usage),         \
+    (target, size, data, usage))                                              \
+  X(void, BufferSubData,                                                      \
+    (GLenum target, GLintptr offset, GLsizeiptr size, const void* data),      \
+    (target, offset, size, data))                                             \
+  X(GLenum, CheckFramebufferStatus, (GLenum target), (target))                \
+  X(GLenum, ClientWaitSync,                                                   \
+    (GLsync sync, GLbitfield flags, GLuint64 timeout),                        \
+    (sync, flags, timeout))                                                   \
+  X(void, Clear, (GLbitfield mask), (mask))                                   \
+  X(void, ClearColor,                                                         \
+    (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha),                \
+    (red, green, blue, alpha))                                                \
+  X(void, CompileShader, (GLuint shader), (shader))                           \
+  X(void, CopyBufferSubData,                                                  \
+    (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,              \
+     GLintptr writeOffset, GLsizeiptr size),                                  \
+    (readTarget, writeTarget, readOffset, writeOffset, size))                 \
+  X(GLuint, CreateProgram, (void), ())                                        \
+  X(GLuint, CreateShader, (GLenum type), (type))                              \
+  X(void, DeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers))    \
+  X(void, DeleteFramebuffers, (GLsizei n, const GLuint* framebuffers),        \
+    (n, framebuffers))                                                        \
+  X(void, DeleteProgram, (GLuint program), (program))                         \
+  X(void, DeleteRenderbuffers, (GLsizei n, const GLuint* renderbuffers),      \
+    (n, renderbuffers))                                                       \
+  X(void, DeleteShader, (GLuint shader), (shader))                            \
+  X(void, DeleteSync, (GLsync sync), (sync))                                  \
+  X(void, DepthFunc, (GLenum func), (func))                                   \
+  X(void, Disable, (GLenum cap), (cap))                                       \
+  X(void, DisableVertexAttribArray, (GLuint index), (index))                  \
+  X(void, DrawElements,                                                       \
+    (GLenum mode, GLsizei count, GLenum type, const void* indices),           \
+    (mode, count, type, indices))                                             \
+  X(void, DrawElementsBaseVertex,                                             \
+    (GLenum mode, GLsizei count, GLenum type, const void* indices,            \
+     GLint basevertex),                                                       \
+    (mode, count, type, indices, basevertex))                                 \
+  X(void, DrawElementsInstanced,                                              \
+    (GLenum mode, GLsizei count, GLenum type, const void* indices,            \
+     GLsizei instancecount),                                                  \
+    (mode, count, type, indices, instancecount))                              \
+  X(void, DrawElementsInstancedBaseVertex,                                    \
+    (GLenum mode, GLsizei count, GLenum type, const void* indices,            \
+     GLsizei instancecount, GLint basevertex),                                \
+    (mode, count, type, indices, instancecount, basevertex))                  \
+  X(void, Enable, (GLenum cap), (cap))                                        \
+  X(void, EnableVertexAttribArray, (GLuint index), (index))                   \
+  X(void, FramebufferRenderbuffer,                                            \
+    (GLenum target, GLenum attachment, GLenum renderbuffertarget,             \
+     GLuint renderbuffer),                                                    \
+    (target, attachment, renderbuffertarget, renderbuffer))                   \
+  X(GLsync, FenceSync, (GLenum condition, GLbitfield flags),                  \
+    (condition, flags))                                                       \
+  X(void, GenBuffers, (GLsizei n, GLuint* buffers), (n, buffers))             \
+  X(void, GenFramebuffers, (GLsizei n, GLuint* framebuffers),                 \
+    (n, framebuffers))                                                        \
+  X(void, GenQueries, (GLsizei n, GLuint* ids), (n, ids))                     \
+  X(void, GenRenderbuffers, (GLsizei n, GLuint* renderbuffers),               \
+    (n, renderbuffers))                                                       \
+  X(void, GenVertexArrays, (GLsizei n, GLuint* arrays), (n, arrays))          \
+  X(void, GetActiveUniform,                                                   \
+    (GLuint program, GLuint index, GLsizei bufSize, GLsizei* length,          \
+     GLint* size, GLenum* type, GLchar* name),                                \
+    (program, index, bufSize, length, size, type, name))                      \
+  X(GLint, GetAttribLocation, (GLuint program, const GLchar* name),           \
+    (program, name))                                                          \
+  X(void, GetBufferSubData,                                                   \
+    (GLenum target, GLintptr offset, GLsizeiptr size, void* data),            \
+    (target, offset, size, data))                                             \
+  X(void, GetIntegerv, (GLenum pname, GLint* data), (pname, data))            \
+  X(void, GetProgramInfoLog,                                                  \
+    (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog),      \
+    (program, bufSize, length, infoLog))                                      \
+  X(void, GetProgramiv, (GLuint program, GLenum pname, GLint* params),        \
+    (program, pname, params))                                                 \
+  X(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint* params),         \
+    (id, pname, params))                                                      \
+  X(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64* params),   \
+    (id, pname, params))                                                      \
+  X(void, GetShaderInfoLog,                                                   \
+    (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog),       \
+    (shader, bufSize, length, infoLog))                                       \
+  X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint* params),          \
+    (shader, pname, params))                                                  \
+  X(GLint, GetUniformLocation, (GLuint program, const GLchar* name),          \
+    (program, name))                                                          \
+  X(void, LinkProgram, (GLuint program), (program))                           \
+  X(void, QueryCounter, (GLuint id, GLenum target), (id, target))             \
+  X(void, ReadPixels,                                                         \
+    (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,          \
+     GLenum type, void* pixels),                                              \
+    (x, y, width, height, format, type, pixels))                              \
+  X(void, RenderbufferStorage,                                                \
+    (GLenum target, GLenum internalformat, GLsizei width, GLsizei height),    \
+    (target, internalformat, width, height))                                  \
+  X(void, ShaderSource,                                                       \
+    (GLuint shader, GLsizei count, const GLchar* const* string,               \
+     const GLint* length),                                                    \
+    (shader, count, string, length))                                          \
+  X(void, UniformMatrix4fv,                                                   \
+    (GLint location, GLsizei count, GLboolean transpose,                      \
+     const GLfloat* value),                                                   \
+    (location, count, transpose, value))                                      \
+  X(void, UseProgram, (GLuint program), (program))                            \
+  X(void, ValidateProgram, (GLuint program), (program))                       \
+  X(void, VertexAttrib4fv, (GLuint index, const GLfloat* v), (index, v))      \
+  X(void, VertexAttribDivisor, (GLuint index, GLuint divisor),                \
+    (index, divisor))                                                         \
+  X(void, VertexAttribPointer,                                                \
+    (GLuint index, GLint size, GLenum type, GLboolean normalized,             \
+     GLsizei stride, const void* pointer),                                    \
+    (index, size, type, normalized, stride, pointer))                         \
+  X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height),        \
+    (x, y, width, height))
+
+typedef struct {
+#define RSG_GL_FIELD(ret, name, params, args) ret(GLAPIENTRY* name) params;
+  RSG_GL_FUNCTIONS(RSG_GL_FIELD)
+#undef RSG_GL_FIELD
+} RsgGl;
+
+/*
+ * Shadow copy of the GL state, to elide redundant state changes
+ */
+#define RSG_GL_MAX_TEXTURE_UNITS 16
+
+typedef struct {
+  GLuint program;
+  GLuint vertexArray;
+  GLuint arrayBuffer;
+  GLuint elementArrayBuffer;
+  GLenum activeTexture;
+  GLuint textures[RSG_GL_MAX_TEXTURE_UNITS];  // GL_TEXTURE_2D, per unit
+  int blend;                                  // -1 if unknown
+  GLenum blendSrc;
+  GLenum blendDst;
+  int depthTest;  // -1 if unknown
+  GLenum depthFunc;
+  vec4s clearColor;
+  bool clearColorValid;
+
+  // statistics
+  size_t frameDraws;
+  size_t frameInstances;
+  size_t lastFrameDraws;
+  size_t lastFrameInstances;
+  size_t frameCalls;
+  size_t frameElided;
+  size_t lastFrameCalls;
+  size_t lastFrameElided;
+  size_t totalCalls;
+  size_t totalElided;
+} RsgGlState;
+
+typedef struct {
+  size_t tested;  // bounding boxes tested against the frustum
+  size_t culled;
+  size_t drawn;  // meshes submitted
+} RsgCullStat;
+
+typedef struct {
+  long long periodNs;
+  long long deadline;  // CLOCK_MONOTONIC, of the next frame
+  size_t frames;
+  size_t missed;
+} RsgScheduler;
+
+/*
+ * EGL context and the framebuffer object that stands in for a window
+ */
+typedef struct {
+  void* display;  // EGLDisplay
+  void* context;  // EGLContext
+  GLuint framebuffer;
+  GLuint colorbuffer;
+  GLuint depthbuffer;
+  int width;
+  int height;
+} RsgOffscreen;
+
 typedef struct {
   GLFWwindow* window;
+  RsgOffscreen* offscreen;  // instead of the window
   size_t totalTraversals;
+  size_t skippedTraversals;
+  bool quit;
+  bool forceRedraw;  // window damaged/resized; redraw even if scene is clean
+  bool pipelined;    // RSG_INIT_FLAG_PIPELINED
+  RsgArena* frameArena;
+  RsgGlState* glState;
+  RsgCullStat cull;
+  RsgCullStat lastFrameCull;
+  RsgScheduler scheduler;  // immediate mode
 } RsgGlobalContext;
 
 typedef struct {
   RsgGlobalContext* global;
   RsgLocalContext* local;
+  RsgArena* frameArena;  // reset before each traversal
+  RsgGlState* gl;
 } RsgContext;
 
+typedef struct RsgRenderList RsgRenderList;
+
 struct RsgClosure {
-  GClosure* gclosure;
+  void (*func)(void* binding, RsgValue* from, RsgValue* to, void* cookie);
   void* data;
 };
 
@@ -66,15 +328,160 @@ struct _RsgAbstractNodeClass {
 
   /* Class virtual function fields. */
   void (*processFunc)(RsgAbstractNode* node, RsgContext* ctx);
+  void (*compileFunc)(RsgAbstractNode* node, RsgRenderList* list);
+  /* Sample external state (input devices, etc.) once per frame, before the
+   * main loop decides whether the scene needs a traversal */
+  void (*pollFunc)(RsgAbstractNode* node, RsgContext* ctx);
+  /* Merge the bounds of what the node draws into box, in the space of model
+   * (which transforms may update), or return false if they can't be known.
+   * NULL for nodes that neither draw nor affect drawing */
+  bool (*boundsFunc)(RsgAbstractNode* node, mat4s* model, vec3s box[2]);
+  /* CPU-only part of processFunc (caches), run in the update phase, possibly
+   * off the GL thread; only ctx->local is available. NULL if none */
+  void (*updateFunc)(RsgAbstractNode* node, RsgContext* ctx);
   //  void (*setPropertyFunc)(RsgAbstractNode* node, const char* name,
   //                          RsgValue value);
   //  RsgValue (*getPropertyFunc)(RsgAbstractNode* node, const char* name);
 
-  /* Padding to allow adding up to 12 new virtual functions without
+  /* Padding to allow adding up to 10 new virtual functions without
    * breaking ABI. */
-  gpointer padding[12];
+  gpointer padding[10];
 };
 
+/*
+ * Compiled render list: a flat command stream replayed in place of the
+ * processFunc traversal. Commands refer to node-owned storage for values
+ * that properties may change, so only structural edits need a recompile.
+ */
+typedef enum {
+  RSG_OP_PROCESS,  // call processFunc of a node that can't be compiled
+  RSG_OP_UPDATE,   // same, for a node that only changes the local context
+  RSG_OP_CALL,     // replay a nested list (e.g. of a child group)
+  RSG_OP_CLEAR,
+  RSG_OP_SET_PROGRAM,
+  RSG_OP_SET_VIEW,
+  RSG_OP_SET_PROJECTION,
+  RSG_OP_DRAW,
+  RSG_OP_DRAW_INSTANCED,  // run of draws of the same geometry
+} RsgOpCode;
+
+/*
+ * What a draw call draws: triangles from the geometry pool. Shared by the
+ * meshes that draw the same thing; compacting the pool moves it in place.
+ */
+typedef struct {
+  GLuint vao;  // the pool's, for the vertex layout
+  GLsizei count;
+  GLenum indexType;    // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+  size_t indexOffset;  // bytes into the element buffer
+  GLint baseVertex;
+
+  // pool bookkeeping
+  int layout;
+  size_t numVertices;
+  size_t indexUnits;  // 4-byte units taken in the element buffer
+  guint slot;         // in the pool's list of geometries
+  int refCount;
+} RsgGeometry;
+
+typedef struct {
+  RsgOpCode code;
+  RsgAbstractNode* node;  // emitting node
+  union {
+    void (*processFunc)(RsgAbstractNode* node, RsgContext* ctx);
+    RsgRenderList* list;
+    const vec4s* color;
+    const RsgShaderProgram* program;
+    const mat4s* matrix;
+    const RsgGeometry* draw;
+    struct {
+      size_t first;  // into instanceOps
+      size_t count;
+    } instances;
+  };
+} RsgOp;
+
+struct RsgRenderList {
+  RsgOp* ops;
+  size_t numOps;
+  size_t capacity;
+  RsgOp* instanceOps;  // draws merged into RSG_OP_DRAW_INSTANCED ops
+  size_t numInstanceOps;
+  size_t instanceOpsCapacity;
+  bool valid;
+  bool saveLocal;  // restore the local context after replay
+  RsgAbstractNode* owner;
+  void (*compileFunc)(RsgAbstractNode* owner, RsgRenderList* list);
+};
+
+/*
+ * Frame packet: a render list resolved into plain values (culled, with world
+ * matrices and local contexts copied), so that another thread can submit it
+ * while the scene moves on. Everything lives in the packet's arena.
+ */
+typedef enum {
+  RSG_PACKET_CLEAR,
+  RSG_PACKET_DRAW,  // also instanced, if numInstances > 1
+  RSG_PACKET_PROCESS,
+} RsgPacketCode;
+
+typedef struct {
+  RsgPacketCode code;
+  const RsgLocalContext* local;  // snapshot to submit with
+  union {
+    vec4s color;
+    struct {
+      const RsgGeometry* geometry;
+      const mat4s** models;
+      size_t numInstances;
+    } draw;
+    struct {
+      RsgAbstractNode* node;
+      void (*processFunc)(RsgAbstractNode* node, RsgContext* ctx);
+    } process;
+  };
+} RsgPacketEntry;
+
+typedef struct RsgPipeline RsgPipeline;
+
+typedef struct {
+  RsgPacketEntry* entries;
+  size_t numEntries;
+  size_t capacity;
+  RsgArena* arena;
+  const RsgLocalContext* snapshot;  // of ctx->local, NULL once it changed
+} RsgPacket;
+
+/*
+ * Mesh geometry in client memory, e.g. read from a file. Vertices are
+ * interleaved: position, then normal and texture coordinate if the layout
+ * has them.
+ */
+#define RSG_MESH_NORMALS 1
+#define RSG_MESH_TEXCOORDS 2
+
+/*
+ * Vertex attribute locations, bound by name before programs are linked. The
+ * mesh attributes are fed from the geometry pool's VAOs; the per-instance
+ * model matrix takes four locations of its own, so instanced draws never
+ * touch the arrays of the shared VAOs.
+ */
+#define RSG_ATTRIB_POSITION 0  // "a_position"
+#define RSG_ATTRIB_NORMAL 1    // "a_normal"
+#define RSG_ATTRIB_TEXCOORD 2  // "a_texcoord"
+#define RSG_ATTRIB_MODEL 4     // "a_model", mat4: 4 to 7
+
+typedef struct {
+  int layout;  // RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS
+  float* vertices;
+  size_t numVertices;
+  GLenum indexType;  // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+  void* indices;     // triangles
+  size_t numIndices;
+  vec3s bounds[2];
+  GMappedFile* mapping;  // if the arrays point into a mapped file
+} RsgMeshData;
+
 /*******************************************************************************
  * FUNCTIONS.
  */
@@ -91,6 +498,128 @@ extern void rsgSetGlobalContext(RsgGlobalContext* gctx);
 
 extern void rsgLocalContextReset(RsgLocalContext* lctx);
 
+extern RsgArena* rsgArenaCreate(size_t size);
+extern void rsgArenaDestroy(RsgArena* arena);
+extern void* rsgArenaAlloc(RsgArena* arena, size_t size);
+extern void rsgArenaReset(RsgArena* arena);
+
+extern void rsgAbstractNodeCompileNothing(RsgAbstractNode* node,
+                                          RsgRenderList* list);
+extern void rsgAbstractNodeMarkDirty(RsgAbstractNode* node);
+extern bool rsgAbstractNodeIsDirty(RsgAbstractNode* node);
+extern void rsgAbstractNodeCleanAll(void);
+extern void rsgAbstractNodeAddParent(RsgAbstractNode* node,
+                                     RsgAbstractNode* parent);
+extern void rsgAbstractNodeRemoveParent(RsgAbstractNode* node,
+                                        RsgAbstractNode* parent);
+extern void rsgAbstractNodeSetPolled(RsgAbstractNode* node);
+extern void rsgAbstractNodePollAll(RsgContext* ctx);
+extern void rsgAbstractNodeNotify(RsgAbstractNode* node, GParamSpec* pspec);
+extern void rsgAbstractNodeFlushNotify(void);
+extern bool rsgAbstractNodeIsNotifyPending(void);
+extern bool rsgAbstractNodeIsShared(RsgAbstractNode* node);
+extern guint rsgAbstractNodeGetGeneration(void);
+extern bool rsgAbstractNodeChangedSince(RsgAbstractNode* node,
+                                        guint generation);
+
+extern RsgRenderList* rsgRenderListCreate(
+    RsgAbstractNode* owner,
+    void (*compileFunc)(RsgAbstractNode* owner, RsgRenderList* list),
+    bool saveLocal);
+extern void rsgRenderListDestroy(RsgRenderList* list);
+extern void rsgRenderListInvalidate(RsgRenderList* list);
+extern void rsgRenderListEmit(RsgRenderList* list, RsgOp op);
+extern void rsgRenderListReplay(RsgRenderList* list, RsgContext* ctx);
+extern void rsgRenderListReplayProfiled(RsgRenderList* list, RsgContext* ctx);
+extern void rsgRenderListResolve(RsgRenderList* list,
+                                 RsgContext* ctx,
+                                 RsgPacket* packet);
+
+typedef void (*RsgGlProc)(void);
+
+extern const RsgGl* rsgGl;
+extern void rsgGlDispatchInit(RsgGlProc (*getProcAddress)(const char* name));
+extern bool rsgGlHasTimerQuery(void);
+
+extern RsgGlState* rsgGlStateCreate(void);
+extern void rsgGlStateInvalidate(RsgGlState* state);
+extern void rsgGlStateBeginFrame(RsgGlState* state);
+extern void rsgGlUseProgram(RsgGlState* state, GLuint program);
+extern void rsgGlBindVertexArray(RsgGlState* state, GLuint vertexArray);
+extern void rsgGlBindBuffer(RsgGlState* state, GLenum target, GLuint buffer);
+extern void rsgGlActiveTexture(RsgGlState* state, GLenum texture);
+extern void rsgGlBindTexture(RsgGlState* state, GLenum target, GLuint texture);
+extern void rsgGlEnable(RsgGlState* state, GLenum cap);
+extern void rsgGlDisable(RsgGlState* state, GLenum cap);
+extern void rsgGlBlendFunc(RsgGlState* state, GLenum sfactor, GLenum dfactor);
+extern void rsgGlDepthFunc(RsgGlState* state, GLenum func);
+extern void rsgGlClearColor(RsgGlState* state, vec4s color);
+
+extern void rsgDrawElements(RsgContext* ctx,
+                            const RsgGeometry* geometry,
+                            const mat4s* model);
+extern void rsgDrawElementsInstanced(RsgContext* ctx,
+                                     const RsgGeometry* geometry,
+                                     const mat4s* const* models,
+                                     size_t numInstances);
+
+extern const mat4s* rsgMeshNodeGetVisibleWorld(RsgAbstractNode* node,
+                                               RsgContext* ctx);
+extern RsgMeshData* rsgMeshDataLoad(const char* path);
+extern void rsgMeshDataDestroy(RsgMeshData* data);
+extern size_t rsgMeshDataGetStride(const RsgMeshData* data);
+extern size_t rsgMeshDataGetIndexSize(const RsgMeshData* data);
+
+extern RsgGeometry* rsgGeometryCreate(const RsgMeshData* data);
+extern RsgGeometry* rsgGeometryRef(RsgGeometry* geometry);
+extern void rsgGeometryUnref(RsgGeometry* geometry);
+extern bool rsgGroupNodeCull(RsgAbstractNode* node, RsgContext* ctx);
+
+extern void rsgBoundsMergeTransformed(vec3s box[2],
+                                      const vec3s local[2],
+                                      const mat4s* model);
+extern bool rsgBoundsCull(RsgContext* ctx,
+                          const vec3s box[2],
+                          const mat4s* model);
+
+extern void rsgPropertySetStorage(GParamSpec* pspec,
+                                  gssize offset,
+                                  void (*changedFunc)(RsgAbstractNode* node));
+extern GParamSpec* rsgPropertyGetPspec(const RsgProperty* prop);
+
+extern void rsgBindingSourceChanged(RsgAbstractNode* node, GParamSpec* pspec);
+extern void rsgBindingEvaluatePending(void);
+extern bool rsgBindingIsPending(void);
+
+extern void rsgUpdateQueueApply(void);
+
+extern bool rsgProfilerBeginFrame(void);
+extern void rsgProfilerEndFrame(void);
+extern void rsgProfilerEnter(RsgAbstractNode* node);
+extern void rsgProfilerLeave(void);
+
+extern RsgOffscreen* rsgOffscreenCreate(int width, int height);
+
+extern void rsgCaptureFrame(void);
+
+extern void rsgSchedulerStart(RsgScheduler* scheduler, int frequency);
+extern void rsgSchedulerWait(RsgScheduler* scheduler);
+
+extern RsgPipeline* rsgPipelineCreate(RsgAbstractNode* root,
+                                      RsgRenderList* rootList);
+extern void rsgPipelineDestroy(RsgPipeline* pipeline);
+extern void rsgPipelineBuildAsync(RsgPipeline* pipeline);
+extern bool rsgPipelineWait(RsgPipeline* pipeline);
+extern bool rsgPipelineIsReady(const RsgPipeline* pipeline);
+extern bool rsgPipelineSubmit(RsgPipeline* pipeline, RsgContext* ctx);
+
+extern bool rsgUpdateSpawn(RsgAbstractNode* node, const RsgLocalContext* local);
+extern void rsgUpdateRun(RsgAbstractNode* root);
+extern void rsgUpdateParallelFor(void (*func)(void* item),
+                                 void* items,
+                                 size_t itemSize,
+                                 size_t numItems);
+
 extern GValue rsgValueToGValue(RsgValue value);
 extern RsgValue rsgGValueToValue(GValue value);
 
@@ -103,3 +632,6 @@ GLuint rsgShaderProgramAssembleFromStrings(const char* vertexString,
                                            const char* fragmentString);
 GLuint rsgShaderProgramAssembleFromFiles(const char* vertexPath,
                                          const char* fragmentPath);
+const RsgShaderProgram* rsgShaderProgramGet(GLuint program);
+GLint rsgShaderProgramGetUniformLocation(const RsgShaderProgram* program,
+                                         const char* name);
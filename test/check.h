@@ -0,0 +1,47 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Shared harness of the headless checks: CHECK() reports a failed condition
+ * with its place and counts it, checkReport() sums up for ctest.
+ */
+
+static int checkFailures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static bool check(bool ok, const char* what, const char* file, int line) {
+  if (ok == false) {
+    printf("%s:%d: failed: %s\n", file, line, what);
+    checkFailures++;
+  }
+  return ok;
+}
+
+// prints the verdict, returns the exit status
+static int checkReport(const char* name) {
+  printf("%s: %s\n", name, checkFailures == 0 ? "ok" : "FAILED");
+  return checkFailures == 0 ? 0 : 1;
+}
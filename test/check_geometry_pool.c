@@ -0,0 +1,184 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+
+#include "check.h"
+#include "rsg_internal.h"
+
+/*
+ * Headless checks of the geometry pool: placement of geometries in the
+ * shared buffers as they come and go, growth and compaction, against the
+ * pool's own statistics. GL calls go to the null backend, so only the
+ * bookkeeping is checked, not the buffer contents.
+ */
+
+#define VERTEX_SIZE (3 * sizeof(float))  // positions only
+#define INDEX_SIZE sizeof(GLuint)
+
+static RsgGeometry* create(int layout, size_t numVertices, size_t numIndices) {
+  RsgMeshData data = {.layout = layout,
+                      .numVertices = numVertices,
+                      .indexType = GL_UNSIGNED_INT,
+                      .numIndices = numIndices};
+  data.vertices = rsgCalloc(numVertices, rsgMeshDataGetStride(&data) *
+                                             sizeof(*data.vertices));
+  data.indices = rsgCalloc(numIndices, INDEX_SIZE);
+  RsgGeometry* geometry = rsgGeometryCreate(&data);
+  rsgFree(data.vertices);
+  rsgFree(data.indices);
+  return geometry;
+}
+
+typedef struct {
+  size_t used;
+  size_t capacity;
+  size_t geometries;
+  size_t holes;
+} Stat;
+
+static Stat getStat(void) {
+  Stat stat;
+  rsgGeometryPoolGetStat(&stat.used, &stat.capacity, &stat.geometries,
+                         &stat.holes);
+  return stat;
+}
+
+static size_t bytesOf(size_t numVertices, size_t numIndices) {
+  return numVertices * VERTEX_SIZE + numIndices * INDEX_SIZE;
+}
+
+static int byBaseVertex(const void* a, const void* b) {
+  const RsgGeometry* ga = *(RsgGeometry* const*)a;
+  const RsgGeometry* gb = *(RsgGeometry* const*)b;
+  return (ga->baseVertex > gb->baseVertex) - (ga->baseVertex < gb->baseVertex);
+}
+
+static int byIndexOffset(const void* a, const void* b) {
+  const RsgGeometry* ga = *(RsgGeometry* const*)a;
+  const RsgGeometry* gb = *(RsgGeometry* const*)b;
+  return (ga->indexOffset > gb->indexOffset) -
+         (ga->indexOffset < gb->indexOffset);
+}
+
+// the ranges of the geometries follow each other from the start
+static bool packed(RsgGeometry** geometries, size_t count) {
+  size_t next = 0;
+  size_t i;
+  qsort(geometries, count, sizeof(*geometries), byBaseVertex);
+  for (i = 0; i < count; i++) {
+    if ((size_t)geometries[i]->baseVertex != next) return false;
+    next += geometries[i]->numVertices;
+  }
+  next = 0;
+  qsort(geometries, count, sizeof(*geometries), byIndexOffset);
+  for (i = 0; i < count; i++) {
+    if (geometries[i]->indexOffset != next) return false;
+    next += geometries[i]->count * INDEX_SIZE;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  rsgInit(0, 0, RSG_INIT_FLAG_NODISPLAY);
+  Stat stat = getStat();
+  CHECK(stat.used == 0 && stat.capacity == 0 && stat.geometries == 0);
+
+  /*
+   * Placed one after another
+   */
+  RsgGeometry* a = create(0, 1000, 3000);
+  RsgGeometry* b = create(0, 2000, 6000);
+  RsgGeometry* c = create(0, 3000, 9000);
+  CHECK(a->baseVertex == 0 && a->indexOffset == 0);
+  CHECK(b->baseVertex == 1000 && b->indexOffset == 3000 * INDEX_SIZE);
+  CHECK(c->baseVertex == 3000 && c->indexOffset == 9000 * INDEX_SIZE);
+  CHECK(a->vao == b->vao && a->count == 3000);
+  stat = getStat();
+  const size_t initialCapacity = stat.capacity;
+  CHECK(stat.used == bytesOf(6000, 18000));
+  CHECK(stat.geometries == 3 && stat.holes == 0);
+
+  /*
+   * Freed ranges merge with their neighbours, and are reused first fit
+   */
+  CHECK(rsgGeometryRef(b) == b);
+  rsgGeometryUnref(b);
+  CHECK(getStat().geometries == 3);  // still referenced
+  rsgGeometryUnref(b);
+  stat = getStat();
+  CHECK(stat.used == bytesOf(4000, 12000));
+  CHECK(stat.geometries == 2 && stat.holes == 2);  // one per buffer
+  rsgGeometryUnref(a);
+  stat = getStat();
+  CHECK(stat.used == bytesOf(3000, 9000) && stat.holes == 2);
+
+  RsgGeometry* d = create(0, 2500, 100);
+  CHECK(d->baseVertex == 0 && d->indexOffset == 0);
+  CHECK(getStat().holes == 2);
+  RsgGeometry* e = create(0, 500, 8900);  // fills both holes exactly
+  CHECK(e->baseVertex == 2500 && e->indexOffset == 100 * INDEX_SIZE);
+  stat = getStat();
+  CHECK(stat.holes == 0 && stat.capacity == initialCapacity);
+
+  /*
+   * Growth keeps the offsets; the new space extends the free tail
+   */
+  const size_t capacityVertices = 1024 * 1024 / VERTEX_SIZE;
+  RsgGeometry* f = create(0, capacityVertices, 30);
+  CHECK(f->baseVertex == 6000 && f->indexOffset == 18000 * INDEX_SIZE);
+  CHECK(c->baseVertex == 3000 && e->baseVertex == 2500);
+  stat = getStat();
+  CHECK(stat.capacity == initialCapacity + capacityVertices * VERTEX_SIZE);
+  CHECK(stat.used == bytesOf(6000 + capacityVertices, 18030));
+  CHECK(stat.holes == 0);
+
+  /*
+   * Compaction packs what is left, in place
+   */
+  rsgGeometryUnref(c);
+  rsgGeometryUnref(d);
+  stat = getStat();
+  CHECK(stat.holes == 4);  // e keeps them apart, in both buffers
+  const size_t used = stat.used;
+  rsgGeometryPoolCompact();
+  stat = getStat();
+  CHECK(stat.used == used && stat.holes == 0 && stat.geometries == 2);
+  CHECK(stat.capacity < initialCapacity + capacityVertices * VERTEX_SIZE);
+  RsgGeometry* left[2] = {e, f};
+  CHECK(packed(left, 2));
+  CHECK(e->count == 8900 && f->count == 30);
+
+  /*
+   * Other layouts get pools of their own
+   */
+  RsgGeometry* g = create(RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS, 10, 30);
+  CHECK(g->vao != e->vao && g->baseVertex == 0 && g->indexOffset == 0);
+  CHECK(getStat().geometries == 3);
+
+  rsgGeometryUnref(e);
+  rsgGeometryUnref(f);
+  rsgGeometryUnref(g);
+  stat = getStat();
+  CHECK(stat.used == 0 && stat.geometries == 0 && stat.holes == 0);
+
+  return checkReport("check_geometry_pool");
+}
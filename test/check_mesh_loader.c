@@ -0,0 +1,381 @@
+/*
+ * Copyright 2021 Nikolay Burkov <nbrk@linklevel.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "rsg_internal.h"
+
+/*
+ * Headless checks of the mesh file loader. The OBJ fixtures are generated
+ * into a temporary directory, each a few chunks long, so that elements are
+ * placed and indices resolved across chunk boundaries; the loaded data is
+ * compared with what the generator knows it wrote. Binary files are
+ * converted from OBJ fixtures and compared with them.
+ */
+
+#define PADDING 200  // bytes of comment between elements, to span chunks
+
+static char* lastWarning = NULL;
+
+static void captureWarning(const gchar* domain,
+                           GLogLevelFlags level,
+                           const gchar* message,
+                           gpointer data) {
+  g_free(lastWarning);
+  lastWarning = g_strdup(message);
+}
+
+static void pad(GString* text) {
+  g_string_append_c(text, '#');
+  while (text->len % PADDING != 0) g_string_append_c(text, '-');
+  g_string_append_c(text, '\n');
+}
+
+static char* writeFixture(const char* dir,
+                          const char* name,
+                          const GString* text) {
+  char* path = g_build_filename(dir, name, NULL);
+  if (g_file_set_contents(path, text->str, text->len, NULL) == false) {
+    printf("Can't write %s\n", path);
+    exit(1);
+  }
+  return path;
+}
+
+static bool sameVec3(vec3s v, float x, float y, float z) {
+  return v.x == x && v.y == y && v.z == z;
+}
+
+/*
+ * Positions only, one quad after every four positions, with indices
+ * relative to the positions defined so far
+ */
+static void checkRelativeIndices(const char* dir) {
+  const size_t numQuads = 12000;
+  GString* text = g_string_new(NULL);
+  size_t q, i;
+
+  for (q = 0; q < numQuads; q++) {
+    g_string_append_printf(text, "v %zu 0 0\nv %zu 0 0\n", q, q + 1);
+    g_string_append_printf(text, "v %zu 1 %.1f\nv %zu 1 0\n", q + 1,
+                           -0.5 * q, q);
+    g_string_append(text, "f -4 -3 -2 -1\n");
+    pad(text);
+  }
+  char* path = writeFixture(dir, "relative.obj", text);
+  CHECK(text->len > 2 * 1024 * 1024);
+  g_string_free(text, TRUE);
+
+  RsgMeshData* data = rsgMeshDataLoad(path);
+  if (CHECK(data != NULL)) {
+    const GLuint* indices = data->indices;
+    CHECK(data->layout == 0);
+    CHECK(data->indexType == GL_UNSIGNED_INT);
+    CHECK(data->numVertices == numQuads * 4);
+    CHECK(data->numIndices == numQuads * 6);
+    for (q = 0; q < numQuads && data->numIndices == numQuads * 6; q++) {
+      const GLuint expected[6] = {q * 4, q * 4 + 1, q * 4 + 2,
+                                  q * 4, q * 4 + 2, q * 4 + 3};
+      const float* corner = data->vertices + (q * 4 + 2) * 3;
+      for (i = 0; i < 6; i++) {
+        if (CHECK(indices[q * 6 + i] == expected[i]) == false) break;
+      }
+      if (CHECK(corner[0] == q + 1 && corner[1] == 1.0f &&
+                corner[2] == -0.5f * q) == false)
+        break;
+    }
+    CHECK(sameVec3(data->bounds[0], 0.0f, 0.0f, -0.5f * (numQuads - 1)));
+    CHECK(sameVec3(data->bounds[1], numQuads, 1.0f, 0.0f));
+    rsgMeshDataDestroy(data);
+  }
+  g_remove(path);
+  g_free(path);
+}
+
+/*
+ * A grid of quads with texture coordinates and normals, all defined after
+ * the faces. Corners of neighbouring quads that share position, texture
+ * coordinate and normal merge; rows alternate normals, so only the corners
+ * within a row do.
+ */
+static void checkCornerMerging(const char* dir) {
+  const int size = 250;  // quads per side
+  const int side = size + 1;
+  GString* text = g_string_new(NULL);
+  GHashTable* numbers = g_hash_table_new(g_direct_hash, g_direct_equal);
+  GArray* expected = g_array_new(FALSE, FALSE, sizeof(GLuint));
+  int x, y;
+  size_t i;
+
+  for (y = 0; y < size; y++) {
+    for (x = 0; x < size; x++) {
+      // fan of a b c d: a b c, a c d
+      const int corners[4] = {y * side + x, y * side + x + 1,
+                              (y + 1) * side + x + 1, (y + 1) * side + x};
+      const int fan[6] = {0, 1, 2, 0, 2, 3};
+      const int normal = y % 2;
+      g_string_append(text, "f");
+      for (i = 0; i < 4; i++)
+        g_string_append_printf(text, " %d/%d/%d", corners[i] + 1,
+                               corners[i] + 1, normal + 1);
+      g_string_append_c(text, '\n');
+
+      // vertices are numbered in order of first use
+      for (i = 0; i < 6; i++) {
+        gpointer key = GINT_TO_POINTER(corners[fan[i]] * 2 + normal + 1);
+        gpointer number = g_hash_table_lookup(numbers, key);
+        if (number == NULL) {
+          number = GUINT_TO_POINTER(g_hash_table_size(numbers) + 1);
+          g_hash_table_insert(numbers, key, number);
+        }
+        GLuint index = GPOINTER_TO_UINT(number) - 1;
+        g_array_append_val(expected, index);
+      }
+    }
+    pad(text);
+  }
+  for (y = 0; y < side; y++) {
+    for (x = 0; x < side; x++)
+      g_string_append_printf(text, "v %d %d 0\nvt %d %d\n", x, y, x, y);
+  }
+  g_string_append(text, "vn 0 0 1\nvn 0 0 -1\n");
+  char* path = writeFixture(dir, "grid.obj", text);
+  CHECK(text->len > 2 * 1024 * 1024);
+  g_string_free(text, TRUE);
+
+  RsgMeshData* data = rsgMeshDataLoad(path);
+  if (CHECK(data != NULL)) {
+    const GLuint* indices = data->indices;
+    const size_t stride = rsgMeshDataGetStride(data);
+    CHECK(data->layout == (RSG_MESH_NORMALS | RSG_MESH_TEXCOORDS));
+    CHECK(stride == 8);
+    CHECK(data->numVertices == g_hash_table_size(numbers));
+    CHECK(data->numIndices == expected->len);
+    for (i = 0; i < expected->len && data->numIndices == expected->len; i++) {
+      if (CHECK(indices[i] == g_array_index(expected, GLuint, i)) == false)
+        break;
+    }
+    // the first quad: position, normal, texture coordinate of its corners
+    const float first[4][8] = {{0, 0, 0, 0, 0, 1, 0, 0},
+                               {1, 0, 0, 0, 0, 1, 1, 0},
+                               {1, 1, 0, 0, 0, 1, 1, 1},
+                               {0, 1, 0, 0, 0, 1, 0, 1}};
+    if (CHECK(data->numVertices >= 4))
+      CHECK(memcmp(data->vertices, first, sizeof(first)) == 0);
+    CHECK(sameVec3(data->bounds[0], 0.0f, 0.0f, 0.0f));
+    CHECK(sameVec3(data->bounds[1], size, size, 0.0f));
+    rsgMeshDataDestroy(data);
+  }
+  g_remove(path);
+  g_free(path);
+  g_hash_table_destroy(numbers);
+  g_array_free(expected, TRUE);
+}
+
+/*
+ * A malformed line past the first chunk is reported with its line number in
+ * the whole file
+ */
+static void checkError(const char* dir,
+                       const char* name,
+                       const char* badLine) {
+  GString* text = g_string_new("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+  size_t line = 4;
+  while (text->len < 3 * 1024 * 1024 / 2) {
+    pad(text);
+    line++;
+  }
+  g_string_append_printf(text, "%s\n", badLine);
+  line++;
+  pad(text);
+  char* path = writeFixture(dir, name, text);
+  g_string_free(text, TRUE);
+
+  char* message = g_strdup_printf("malformed line %zu", line);
+  g_free(lastWarning);
+  lastWarning = NULL;
+  RsgMeshData* data = rsgMeshDataLoad(path);
+  CHECK(data == NULL);
+  CHECK(lastWarning != NULL && strstr(lastWarning, message) != NULL);
+  if (data != NULL) rsgMeshDataDestroy(data);
+  g_free(message);
+  g_remove(path);
+  g_free(path);
+}
+
+/*
+ * Binary files: what rsgMeshFileConvert() writes loads back as the OBJ did,
+ * with 16-bit indices when they do, each array aligned in the mapping
+ */
+#define FILE_ALIGNMENT 64
+#define FILE_VERSION_AT 4        // guint32, see FileHeader in r_mesh_loader.c
+#define FILE_VERTEX_OFFSET_AT 40  // guint64
+#define FILE_INDEX_OFFSET_AT 48   // guint64
+
+static char* writeGrid(const char* dir, const char* name, int size) {
+  GString* text = g_string_new(NULL);
+  int x, y;
+  for (y = 0; y <= size; y++) {
+    for (x = 0; x <= size; x++)
+      g_string_append_printf(text, "v %d %d 0\nvt %d %d\n", x, y, x, y);
+  }
+  for (y = 0; y < size; y++) {
+    for (x = 0; x < size; x++) {
+      const int a = y * (size + 1) + x + 1;
+      const int d = a + size + 1;
+      g_string_append_printf(text, "f %d/%d %d/%d %d/%d %d/%d\n", a, a, a + 1,
+                             a + 1, d + 1, d + 1, d, d);
+    }
+  }
+  char* path = writeFixture(dir, name, text);
+  g_string_free(text, TRUE);
+  return path;
+}
+
+static bool aligned(const void* p) {
+  return (guintptr)p % FILE_ALIGNMENT == 0;
+}
+
+static GLuint indexAt(const RsgMeshData* data, size_t i) {
+  if (data->indexType == GL_UNSIGNED_SHORT)
+    return ((const GLushort*)data->indices)[i];
+  return ((const GLuint*)data->indices)[i];
+}
+
+static void checkBinary(const char* dir, int size, GLenum indexType) {
+  char* objPath = writeGrid(dir, "binary.obj", size);
+  char* path = g_build_filename(dir, "binary.rsgm", NULL);
+  size_t i;
+
+  CHECK(rsgMeshFileConvert(objPath, path));
+  RsgMeshData* obj = rsgMeshDataLoad(objPath);
+  RsgMeshData* data = rsgMeshDataLoad(path);
+  if (CHECK(obj != NULL && data != NULL)) {
+    const size_t stride = rsgMeshDataGetStride(data);
+    CHECK(data->mapping != NULL);
+    CHECK(data->layout == RSG_MESH_TEXCOORDS);
+    CHECK(data->indexType == indexType);
+    CHECK(aligned(data->vertices) && aligned(data->indices));
+    CHECK(data->numVertices == obj->numVertices);
+    CHECK(data->numIndices == obj->numIndices);
+    if (data->numVertices == obj->numVertices)
+      CHECK(memcmp(data->vertices, obj->vertices,
+                   data->numVertices * stride * sizeof(float)) == 0);
+    for (i = 0; i < data->numIndices && data->numIndices == obj->numIndices;
+         i++) {
+      if (CHECK(indexAt(data, i) == indexAt(obj, i)) == false) break;
+    }
+    CHECK(memcmp(data->bounds, obj->bounds, sizeof(data->bounds)) == 0);
+  }
+  if (obj != NULL) rsgMeshDataDestroy(obj);
+  if (data != NULL) rsgMeshDataDestroy(data);
+  g_remove(objPath);
+  g_remove(path);
+  g_free(objPath);
+  g_free(path);
+}
+
+/*
+ * A damaged binary file is rejected with the reason, never mapped for GL
+ */
+static void checkBadBinary(const char* dir,
+                           const char* what,
+                           void (*damage)(char* contents, gsize* length),
+                           const char* reason) {
+  char* objPath = writeGrid(dir, "damaged.obj", 4);
+  char* path = g_build_filename(dir, "damaged.rsgm", NULL);
+  char* contents = NULL;
+  gsize length = 0;
+
+  CHECK(rsgMeshFileConvert(objPath, path));
+  if (CHECK(g_file_get_contents(path, &contents, &length, NULL))) {
+    damage(contents, &length);
+    g_file_set_contents(path, contents, length, NULL);
+    g_free(contents);
+
+    g_free(lastWarning);
+    lastWarning = NULL;
+    RsgMeshData* data = rsgMeshDataLoad(path);
+    if (CHECK(data == NULL) == false) {
+      printf("  (%s)\n", what);
+      rsgMeshDataDestroy(data);
+    }
+    CHECK(lastWarning != NULL && strstr(lastWarning, reason) != NULL);
+  }
+  g_remove(objPath);
+  g_remove(path);
+  g_free(objPath);
+  g_free(path);
+}
+
+static guint64 fieldAt(const char* contents, size_t offset) {
+  guint64 value;
+  memcpy(&value, contents + offset, sizeof(value));
+  return value;
+}
+
+static void damageVersion(char* contents, gsize* length) {
+  const guint32 version = 99;
+  memcpy(contents + FILE_VERSION_AT, &version, sizeof(version));
+}
+
+static void damageAlignment(char* contents, gsize* length) {
+  const guint64 offset = fieldAt(contents, FILE_VERTEX_OFFSET_AT) + 4;
+  memcpy(contents + FILE_VERTEX_OFFSET_AT, &offset, sizeof(offset));
+}
+
+static void damageLength(char* contents, gsize* length) {
+  *length -= 2;  // the last index is cut off
+}
+
+static void damageIndex(char* contents, gsize* length) {
+  const GLushort index = 25;  // the grid has 25 vertices
+  memcpy(contents + fieldAt(contents, FILE_INDEX_OFFSET_AT) + 2, &index,
+         sizeof(index));
+}
+
+int main(int argc, char** argv) {
+  rsgInit(0, 0, RSG_INIT_FLAG_NODISPLAY);
+  g_log_set_default_handler(captureWarning, NULL);
+
+  char* dir = g_dir_make_tmp("rsg_check_XXXXXX", NULL);
+  if (dir == NULL) {
+    printf("Can't create a temporary directory\n");
+    return 1;
+  }
+  checkRelativeIndices(dir);
+  checkCornerMerging(dir);
+  checkError(dir, "bad_float.obj", "v 1 2");
+  checkError(dir, "bad_index.obj", "f -1 -2 -4");
+  checkError(dir, "bad_corner.obj", "f 1/1/1 2/1/1 3/1/1");
+  checkBinary(dir, 10, GL_UNSIGNED_SHORT);
+  checkBinary(dir, 300, GL_UNSIGNED_INT);  // past 65536 vertices
+  checkBadBinary(dir, "version", damageVersion, "bad header");
+  checkBadBinary(dir, "alignment", damageAlignment, "bad header");
+  checkBadBinary(dir, "length", damageLength, "bad header");
+  checkBadBinary(dir, "index", damageIndex, "index out of range");
+  g_rmdir(dir);
+  g_free(dir);
+
+  return checkReport("check_mesh_loader");
+}
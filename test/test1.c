@@ -27,13 +27,13 @@
 static const char* vertex_0 =
     "#version 330\n"
     "layout(location = 0) in vec3 a_position;\n"
-    "uniform mat4 u_model;\n"
+    "layout(location = 4) in mat4 a_model;\n"
     "uniform mat4 u_view;\n"
     "uniform mat4 u_projection;\n"
     "void main()\n"
     "{\n"
-    "//gl_Position = u_projection * u_view * u_model * vec4(a_position, 1.0);\n"
-    "gl_Position = u_projection * u_view * vec4(a_position, 1.0);\n"
+    "gl_Position = u_projection * u_view * a_model * vec4(a_position, 1.0);\n"
+    "//gl_Position = u_projection * u_view * vec4(a_position, 1.0);\n"
     "//gl_Position = vec4(a_position, 1.0);\n"
     "}\n"
     "\n";
@@ -58,7 +58,10 @@ static void printIntCookie(void* cookie) {
 }
 
 static void mult(void* b, RsgValue* from, RsgValue* to, float* f) {
-  to->asFloat = from->asFloat * *f;
+  if (from->type == RSG_VALUE_INT)
+    to->asFloat = from->asInt * *f;
+  else
+    to->asFloat = from->asFloat * *f;
 }
 
 int main(int argc, char** argv) {
@@ -71,8 +74,18 @@ int main(int argc, char** argv) {
   RsgNode* mouse1 = rsgMouseManipulatorNodeCreate();
   RsgNode* printer1 = rsgPropertyPrinterNodeCreate();
   RsgNode* mesh1 = rsgMeshNodeCreateTriangle();
+  // siblings sharing the geometry of mesh1: drawn as one instanced call
+  RsgNode* mesh2 = rsgMeshNodeCreateShared(mesh1);
+  RsgNode* mesh3 = rsgMeshNodeCreateShared(mesh1);
+  RsgNode* transform1 =
+      rsgTransformNodeCreate(glms_translate_make((vec3s){{0.0f, 0.5f, 0.0f}}));
   RsgNode* shader1 = rsgShaderNodeCreateFromMemory(vertex_0, fragment_0);
 
+  vec3s left = {{-1.0f, 0.0f, 0.0f}};
+  vec3s right = {{1.0f, 0.0f, 0.0f}};
+  rsgNodeSetProperty(mesh2, "model", rsgValueMat4(glms_translate_make(left)));
+  rsgNodeSetProperty(mesh3, "model", rsgValueMat4(glms_translate_make(right)));
+
   //  rsgNodeBindProperty(mouse1, "x", printer1, "int1");
   //  rsgNodeBindProperty(mouse1, "y", printer1, "int2");
 
@@ -93,7 +106,10 @@ int main(int argc, char** argv) {
   rsgGroupNodeAddChild(group1, camera1);
   rsgGroupNodeAddChild(group1, printer1);
   rsgGroupNodeAddChild(group1, shader1);
+  rsgGroupNodeAddChild(group1, transform1);
   rsgGroupNodeAddChild(group1, mesh1);
+  rsgGroupNodeAddChild(group1, mesh2);
+  rsgGroupNodeAddChild(group1, mesh3);
   //  rsgGroupNodeAddChild(group1, callback1);
   //  rsgGroupNodeAddChild(group1, callback2);
 